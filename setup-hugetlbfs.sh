@@ -1,6 +1,7 @@
 #!/bin/bash
+# usage: setup-hugetlbfs.sh [number of 1 GB pages per numa node]
 mkdir -p /mnt/huge
-(mount | grep /mnt/huge) > /dev/null || mount -t hugetlbfs nodev /mnt/huge
+mountpoint -q /mnt/huge || mount -t hugetlbfs -o pagesize=2M nodev /mnt/huge
 for i in {0..7}
 do
 	if [[ -e "/sys/devices/system/node/node$i" ]]
@@ -8,3 +9,16 @@ do
 		echo 512 > /sys/devices/system/node/node$i/hugepages/hugepages-2048kB/nr_hugepages
 	fi
 done
+# optional 1 GB pages in /mnt/huge-1G, use them with IXY_HUGETLBFS=/mnt/huge-1G
+if [[ -n "$1" && "$1" -gt 0 ]]
+then
+	mkdir -p /mnt/huge-1G
+	mountpoint -q /mnt/huge-1G || mount -t hugetlbfs -o pagesize=1G nodev /mnt/huge-1G
+	for i in {0..7}
+	do
+		if [[ -e "/sys/devices/system/node/node$i/hugepages/hugepages-1048576kB" ]]
+		then
+			echo $1 > /sys/devices/system/node/node$i/hugepages/hugepages-1048576kB/nr_hugepages
+		fi
+	done
+fi
@@ -64,6 +64,33 @@ void stack_allocator_free(struct allocator* a);
  */
 struct allocator* spinlock_stack_allocator_new(uint32_t num_entries, uint32_t entry_size, struct allocator* parent);
 
+/**
+ * Lock protecting the stack of a spinlock stack allocator.
+ * @STACK_LOCK_SPINLOCK   Test-and-set lock (rte_spinlock.h), fastest without contention
+ * @STACK_LOCK_TICKETLOCK Fair lock (rte_ticketlock.h), threads are served in order
+ * @STACK_LOCK_MCSLOCK    Fair queued lock (rte_mcslock.h), every waiter spins on its own cache line
+ * @STACK_LOCK_SPINLOCK_TM Test-and-set lock elided with Intel TSX (RTM) transactions, a plain spinlock without RTM
+ */
+enum stack_lock_type {
+    STACK_LOCK_SPINLOCK,
+    STACK_LOCK_TICKETLOCK,
+    STACK_LOCK_MCSLOCK,
+    STACK_LOCK_SPINLOCK_TM
+};
+
+/**
+ * Same as spinlock_stack_allocator_new() with a choice of the lock type.
+ * The fair locks avoid starvation and cache line storms when many threads share one stack.
+ * Thread-safe.
+ * @param num_entries Number of slots
+ * @param entry_size  Size of each element
+ * @param parent      Allocator to source memory from
+ * @param lock_type   Lock to protect the stack with
+ * @return New stack allocator or NULL if parent is out of memory
+ * @see spinlock_stack_allocator_free()
+ */
+struct allocator* spinlock_stack_allocator_new_lock(uint32_t num_entries, uint32_t entry_size, struct allocator* parent, enum stack_lock_type lock_type);
+
 /**
  *
  * @param a
@@ -71,6 +98,25 @@ struct allocator* spinlock_stack_allocator_new(uint32_t num_entries, uint32_t en
  */
 void spinlock_stack_allocator_free(struct allocator* a);
 
+/**
+ * Creates a new lock-free stack allocator, a drop-in replacement for spinlock_stack_allocator_new().
+ * Allocations and deallocations are a single CAS on the top of the stack, a preempted thread never blocks others.
+ * Thread-safe.
+ * @param num_entries Number of slots, must be less than UINT32_MAX
+ * @param entry_size  Size of each element
+ * @param parent      Allocator to source memory from
+ * @return New lock-free stack allocator or NULL if parent is out of memory
+ * @see lockfree_stack_allocator_free()
+ */
+struct allocator* lockfree_stack_allocator_new(uint32_t num_entries, uint32_t entry_size, struct allocator* parent);
+
+/**
+ * Destroys a lock-free stack allocator and returns its memory to the parent.
+ * Must not be called while other threads still use the allocator.
+ * @param a Allocator created with lockfree_stack_allocator_new()
+ */
+void lockfree_stack_allocator_free(struct allocator* a);
+
 /**
  * Creates a new fallback allocator.
  * A fallback allocator is thread-safe if both primary and secondary are.
@@ -87,6 +133,119 @@ struct allocator* fallback_allocator_new(struct allocator* primary, struct alloc
  */
 void fallback_allocator_free(struct allocator* a);
 
+/**
+ * Creates a new segregator allocator that routes each request by its size to one of several child allocators,
+ * e.g., stack allocators with 128 byte, 2 KB and 9 KB entries on top of dma_allocator_t.
+ * Class i serves the requests larger than class_sizes[i - 1] and up to class_sizes[i] bytes, the class is found with
+ * a single table lookup. Blocks are routed back by their size, so a child must not hand out blocks larger than its
+ * class size: use the class size as the entry size of a stack allocator.
+ * A segregator allocator is thread-safe if all children and large are.
+ * @param class_sizes Upper size limit of each class, strictly increasing
+ * @param children    Allocator for each class, copied
+ * @param num_classes Number of classes, at most 255
+ * @param large       Allocator for requests larger than the largest class, NULL to fail them
+ * @return New segregator allocator or NULL if out of memory
+ * @see segregator_allocator_free()
+ */
+struct allocator* segregator_allocator_new(const size_t* class_sizes, struct allocator* const* children, uint32_t num_classes, struct allocator* large);
+
+/**
+ * Destroys and frees a segregator allocator. All objects allocated with it remain valid.
+ * The children are not touched.
+ * @param a Allocator to destroy
+ */
+void segregator_allocator_free(struct allocator* a);
+
+/**
+ * Creates a new arena (bump pointer) allocator for short-lived objects, e.g., scratch memory that is only needed while
+ * processing one batch of packets. Allocating is a pointer increment, blocks are 16 byte aligned.
+ * Deallocating is a no-op unless the block is the most recent allocation, arena_allocator_reset() frees everything.
+ * Not thread-safe.
+ * @param size   Capacity of the arena in bytes
+ * @param parent Allocator to source memory from, e.g., dma_allocator_t to place the arena in a huge page
+ * @return New arena allocator or NULL if parent is out of memory
+ * @see arena_allocator_free()
+ */
+struct allocator* arena_allocator_new(size_t size, struct allocator* parent);
+
+/**
+ * Frees all blocks allocated from an arena at once, O(1).
+ * @param a Allocator created with arena_allocator_new()
+ */
+void arena_allocator_reset(struct allocator* a);
+
+/**
+ * Destroys an arena allocator and returns its memory to the parent. All blocks allocated with it become invalid.
+ * @param a Allocator created with arena_allocator_new()
+ */
+void arena_allocator_free(struct allocator* a);
+
+/**
+ * Number of threads that get their own counters in a stats allocator, further threads share one slot.
+ */
+#define STATS_ALLOCATOR_MAX_THREADS 64
+
+/**
+ * Counters of a stats allocator, either of all threads or of a single thread.
+ * @bytes_in_use     Allocated minus free'd bytes, negative for a thread that frees blocks allocated by others
+ * @max_bytes_in_use High-water mark. Per thread: of the memory held by the thread. Aggregated: the highest value
+ *                   seen by stats_allocator_read(), i.e., it is only as precise as the read interval.
+ */
+struct allocator_stats {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t failures;
+    uint64_t bytes_allocated;
+    uint64_t bytes_freed;
+    int64_t bytes_in_use;
+    uint64_t max_bytes_in_use;
+};
+
+/**
+ * Creates a new stats allocator, a decorator that counts the operations on parent.
+ * Each thread counts in its own cache line without atomic operations, so it can stay enabled in production.
+ * Thread-safe if parent is.
+ * @param parent Allocator to forward all requests to
+ * @return New stats allocator or NULL if out of memory
+ * @see stats_allocator_read(), stats_allocator_free()
+ */
+struct allocator* stats_allocator_new(struct allocator* parent);
+
+/**
+ * Sums up the counters of all threads. Can be called from any thread at any time.
+ * @param a     Allocator created with stats_allocator_new()
+ * @param stats Filled with the aggregated counters
+ */
+void stats_allocator_read(struct allocator* a, struct allocator_stats* stats);
+
+/**
+ * Reads the counters of a single thread, e.g., to find the thread that holds on to buffers.
+ * @param a           Allocator created with stats_allocator_new()
+ * @param thread_slot Slot of the thread, see stats_allocator_thread_slot()
+ * @param stats       Filled with the counters of the thread
+ * @return false if the thread never used the allocator
+ */
+bool stats_allocator_read_thread(struct allocator* a, uint32_t thread_slot, struct allocator_stats* stats);
+
+/**
+ * Returns the counter slot of the calling thread, the same for all stats allocators.
+ * STATS_ALLOCATOR_MAX_THREADS is the slot shared by all threads that didn't get their own.
+ */
+uint32_t stats_allocator_thread_slot();
+
+/**
+ * Prints the aggregated counters and the memory held by each thread to stdout.
+ * @param a    Allocator created with stats_allocator_new()
+ * @param name Prefix of the output lines
+ */
+void stats_allocator_print(struct allocator* a, const char* name);
+
+/**
+ * Destroys a stats allocator. Blocks allocated with it remain valid and belong to the parent.
+ * @param a Allocator created with stats_allocator_new()
+ */
+void stats_allocator_free(struct allocator* a);
+
 /**
  * Creates a new null allocator. Null allocators don't allocate memory and always return
  * memory blocks with pointer to NULL and size 0. Mostly useful for debugging or testing.
@@ -132,6 +291,16 @@ extern struct allocator mallocator_t;
  */
 struct allocator* dma_allocator_new();
 
+/**
+ * Creates a new DMA allocator that places its huge pages on the given NUMA node.
+ * The node is a preference: a warning is logged if the node has no free huge pages left.
+ * Thread-safe.
+ * @param numa_node NUMA node to allocate from, usually the node of the NIC (see pci_numa_node()); -1 for any node
+ * @return New DMA allocator object
+ * @see    dma_allocator_free()
+ */
+struct allocator* dma_allocator_new_node(int numa_node);
+
 /**
  *
  * @param a
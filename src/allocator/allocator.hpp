@@ -0,0 +1,101 @@
+#ifndef IXY_ALLOCATOR_HPP
+#define IXY_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+#include "allocator/allocator.h"
+
+namespace ixy {
+    /**
+     * Standard library allocator on top of a struct allocator, puts containers into huge pages or pools, e.g.,
+     *
+     *   auto arena = arena_allocator_new(1 << 21, &dma_allocator_t);
+     *   std::unordered_map<flow_key, flow, flow_hash, std::equal_to<flow_key>,
+     *           ixy::allocator_adapter<std::pair<const flow_key, flow>>> flows(1024, flow_hash(), {}, arena);
+     *
+     * The adapter only holds the pointer, copies (also rebound ones for node types) share the underlying
+     * allocator, which must outlive all of them. It is as thread-safe as the underlying allocator.
+     *
+     * Allocators may hand out larger blocks than requested (whole stack entries, huge pages) and need the block
+     * size back on deallocation, so every allocation is prefixed with the size of its block. The prefix is
+     * sizeof(size_t) or alignof(T), whichever is larger.
+     */
+    template<typename T>
+    class allocator_adapter {
+    public:
+        using value_type = T;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        // the allocator travels with the memory it allocated
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::false_type;
+
+        template<typename U>
+        struct rebind {
+            using other = allocator_adapter<U>;
+        };
+
+        // implicit, so that containers can be constructed directly from a struct allocator*
+        allocator_adapter(struct allocator* a) noexcept : a(a) {}
+
+        template<typename U>
+        allocator_adapter(const allocator_adapter<U>& other) noexcept : a(other.underlying()) {}
+
+        T* allocate(size_type n) {
+            if (n > max_size())
+                throw std::bad_array_new_length();
+            struct mem_blk blk = a->allocate(a, header_size + n * sizeof(T));
+            if (!blk.ptr)
+                throw std::bad_alloc();
+            if (reinterpret_cast<std::uintptr_t>(blk.ptr) % alignof(T)) {
+                a->deallocate(a, &blk);
+                throw std::bad_alloc();
+            }
+            std::memcpy(blk.ptr, &blk.size, sizeof(blk.size));
+            return reinterpret_cast<T*>(static_cast<std::uint8_t*>(blk.ptr) + header_size);
+        }
+
+        void deallocate(T* p, size_type) noexcept {
+            struct mem_blk blk;
+            blk.ptr = reinterpret_cast<std::uint8_t*>(p) - header_size;
+            std::memcpy(&blk.size, blk.ptr, sizeof(blk.size));
+            a->deallocate(a, &blk);
+        }
+
+        size_type max_size() const noexcept {
+            return (std::numeric_limits<size_type>::max() - header_size) / sizeof(T);
+        }
+
+        struct allocator* underlying() const noexcept {
+            return a;
+        }
+
+    private:
+        static constexpr size_type header_size = alignof(T) > sizeof(size_type) ? alignof(T) : sizeof(size_type);
+
+        struct allocator* a;
+    };
+
+    template<typename T>
+    constexpr typename allocator_adapter<T>::size_type allocator_adapter<T>::header_size;
+
+    // memory from one adapter can be returned through the other
+    template<typename T, typename U>
+    bool operator==(const allocator_adapter<T>& lhs, const allocator_adapter<U>& rhs) noexcept {
+        return lhs.underlying() == rhs.underlying();
+    }
+
+    template<typename T, typename U>
+    bool operator!=(const allocator_adapter<T>& lhs, const allocator_adapter<U>& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+}
+
+#endif //IXY_ALLOCATOR_HPP
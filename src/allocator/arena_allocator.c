@@ -0,0 +1,81 @@
+#include "allocator.h"
+#include "allocator_common.h"
+
+#include "log.h"
+
+// every block starts at a multiple of this, sufficient for all basic types
+#define ARENA_ALIGNMENT 16u
+
+struct arena_allocator {
+    struct allocator vfs;
+    struct allocator* parent;
+    struct mem_blk mem;
+    // first free byte
+    uint8_t* top;
+    uint8_t* end;
+};
+
+static inline size_t arena_round(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+}
+
+static struct mem_blk allocate(struct allocator* a, size_t size) {
+    struct arena_allocator* self = container_of(a, struct arena_allocator, vfs);
+    size_t rounded = arena_round(size);
+    if (rounded > (size_t) (self->end - self->top) || !size)
+        return (struct mem_blk) {NULL, 0};
+    struct mem_blk blk = {self->top, size};
+    self->top += rounded;
+    return blk;
+}
+
+// only the most recent allocation is actually returned, everything else is reclaimed by arena_allocator_reset()
+static void deallocate(struct allocator* a, struct mem_blk* blk) {
+    struct arena_allocator* self = container_of(a, struct arena_allocator, vfs);
+    if ((uint8_t*) blk->ptr + arena_round(blk->size) == self->top)
+        self->top = blk->ptr;
+#if !defined(NDEBUG)
+    blk->ptr = NULL;
+    blk->size = 0;
+#endif
+}
+
+static bool owns(struct allocator* a, const struct mem_blk* blk) {
+    struct arena_allocator* self = container_of(a, struct arena_allocator, vfs);
+    return (uint8_t*) blk->ptr >= (uint8_t*) self->mem.ptr && (uint8_t*) blk->ptr < self->end;
+}
+
+struct allocator* arena_allocator_new(size_t size, struct allocator* parent) {
+    struct allocator a = {
+            ARENA_ALIGNMENT,
+            allocate,
+            deallocate,
+            owns
+    };
+    struct arena_allocator* arena = malloc(sizeof(*arena));
+    if (!arena)
+        return NULL;
+    memcpy(&arena->vfs, &a, sizeof(a));
+    arena->parent = parent;
+    arena->mem = parent->allocate(parent, size);
+    if (!arena->mem.ptr) {
+        free(arena);
+        return NULL;
+    }
+    if ((uintptr_t) arena->mem.ptr % ARENA_ALIGNMENT)
+        error("memory %p from parent allocator is not aligned to %u bytes", arena->mem.ptr, ARENA_ALIGNMENT);
+    arena->top = arena->mem.ptr;
+    arena->end = (uint8_t*) arena->mem.ptr + arena->mem.size;
+    return &arena->vfs;
+}
+
+void arena_allocator_reset(struct allocator* a) {
+    struct arena_allocator* self = container_of(a, struct arena_allocator, vfs);
+    self->top = self->mem.ptr;
+}
+
+void arena_allocator_free(struct allocator* a) {
+    struct arena_allocator* self = container_of(a, struct arena_allocator, vfs);
+    self->parent->deallocate(self->parent, &self->mem);
+    free(self);
+}
@@ -1,10 +1,9 @@
 #include "allocator.h"
 #include "allocator_common.h"
 #include "log.h"
+#include "hugepage.h"
 
 #include <stddef.h>
-#include <linux/limits.h>
-#include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <inttypes.h>
@@ -14,37 +13,12 @@ struct dma_allocator {
     struct allocator vfs;
     void* base_addr;
     uintptr_t base_addr_phy;
+    int numa_node;
 };
 
-// translate a virtual address to a physical one via /proc/self/pagemap
-static uintptr_t virt_to_phys(void* virt) {
-    long pagesize = sysconf(_SC_PAGESIZE);
-    int fd = check_err(open("/proc/self/pagemap", O_RDONLY), "getting pagemap");
-    // pagemap is an array of pointers for each 4096 byte page
-    check_err(lseek(fd, (uintptr_t) virt / pagesize * sizeof(uintptr_t), SEEK_SET), "getting pagemap");
-    static_assert(sizeof(uintptr_t) == sizeof(uint64_t), "size mismatch");
-    uint64_t phy = 0;
-    check_err(read(fd, &phy, sizeof(phy)), "translating address");
-    close(fd);
-    uint64_t pfn = phy & 0x7fffffffffffffULL;
-    if (!phy) {
-        debug("page info for %p:\n"
-                      "\tpfn: %lu\n"
-                      "\tsoft-dirty: %lu\n"
-                      "\texclusive: %lu\n"
-                      "\tfile-page: %lu\n"
-                      "\tswapped: %lu\n"
-                      "\tpresent: %lu",
-              virt, pfn, (phy >> 54) & 1, (phy >> 56) & 1, (phy >> 61) & 1, (phy >> 62) & 1, (phy >> 63) & 1
-        );
-        error("failed to translate virtual address %p to physical address", virt);
-    }
-    // bits 0-54 are the page number
-    return pfn * pagesize + ((uintptr_t) virt) % pagesize;
-}
-
+// checks one address per huge page, a huge page itself is always physically continuous
 static bool is_phys_continuous(struct mem_blk* blk) {
-    long pagesize = sysconf(_SC_PAGESIZE);
+    long pagesize = (long) hugepage_size();
     uintptr_t virt_base = (uintptr_t) blk->ptr;
     if (virt_base % (unsigned long) pagesize)
         error("memory block does not start at page boundary");
@@ -68,39 +42,17 @@ static bool is_phys_continuous(struct mem_blk* blk) {
     return true;
 }
 
-static uint32_t huge_pg_id;
-
 // allocate memory suitable for DMA access in huge pages
-// this requires hugetlbfs to be mounted at /mnt/huge
-// (not using anonymous hugepages because madvise might fail in subtle ways with some kernel configurations)
-// caution: very wasteful when allocating small chunks
-// this could be fixed by co-locating allocations on the same page until a request would be too large
-static struct mem_blk allocate(struct allocator* a, size_t size) {
-    // round up to multiples of 2 MB if necessary, this is the wasteful part
-    // when fixing this: make sure to align on 128 byte boundaries (82599 dma requirement)
-    if (size % (1 << 21)) {
-        size = ((size >> 21) + 1) << 21;
-    }
-    // C11 stdatomic.h requires a too recent gcc, we want to support gcc 4.8
-    uint32_t id = __sync_fetch_and_add(&huge_pg_id, 1);
-    char path[PATH_MAX];
-    snprintf(path, PATH_MAX, "/mnt/huge/ixy-%d-%d", getpid(), id);
-    // temporary file, will be deleted to prevent leaks of persistent pages
-    int fd = check_err(open(path, O_CREAT | O_RDWR, S_IRWXU), "open hugetlbfs file, check that /mnt/huge is mounted");
-    check_err(ftruncate(fd, (off_t) size), "allocate huge page memory, check hugetlbfs configuration");
-    void* virt_addr = (void*) check_err(mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_HUGETLB, fd, 0), "mmap hugepage");
-    // never swap out DMA memory
-    check_err(mlock(virt_addr, size), "disable swap for DMA memory");
-    // don't keep it around in the hugetlbfs
-    close(fd);
-    unlink(path);
-    // touch every page so they are not lazily allocated and virt_to_phys() can resolve their address
-    for (void* i = virt_addr; i < virt_addr + size; i+=1u<<21) {
-        volatile uint8_t temp = ((volatile uint8_t*)i)[0];
-        ((volatile uint8_t*)i)[0] = temp;
+// this requires hugetlbfs to be mounted, see hugepage_size()
+// caution: very wasteful when allocating small chunks, memory_allocate_dma() packs them into shared pages instead
+static struct mem_blk allocate_on_node(size_t size, int numa_node) {
+    // round up to multiples of the huge page size if necessary, this is the wasteful part
+    size_t page_size = hugepage_size();
+    if (size % page_size) {
+        size = (size / page_size + 1) * page_size;
     }
     struct mem_blk blk = {
-            .ptr = virt_addr,
+            .ptr = hugepage_map(size, numa_node),
             .size = size
     };
     if (!is_phys_continuous(&blk))
@@ -108,7 +60,17 @@ static struct mem_blk allocate(struct allocator* a, size_t size) {
     return blk;
 }
 
+static struct mem_blk allocate(struct allocator* a, size_t size) {
+    return allocate_on_node(size, -1);
+}
+
+static struct mem_blk allocate_node(struct allocator* a, size_t size) {
+    struct dma_allocator* self = container_of(a, struct dma_allocator, vfs);
+    return allocate_on_node(size, self->numa_node);
+}
+
 static void deallocate(struct allocator* a, struct mem_blk* blk) {
+    virt_to_phys_invalidate(blk->ptr, blk->size);
     check_err(munmap(blk->ptr, blk->size), "unmapping memory");
 }
 
@@ -126,6 +88,22 @@ struct allocator dma_allocator_t = {
 struct allocator* dma_allocator_new() {
     struct dma_allocator* dma = malloc(sizeof(*dma));
     memcpy(&dma->vfs, &dma_allocator_t, sizeof(dma_allocator_t));
+    dma->numa_node = -1;
+    return &dma->vfs;
+}
+
+struct allocator* dma_allocator_new_node(int numa_node) {
+    if (numa_node < -1 || numa_node >= MAX_NUMA_NODES)
+        error("numa node %d out of range, limit is %d", numa_node, MAX_NUMA_NODES - 1);
+    struct dma_allocator* dma = malloc(sizeof(*dma));
+    struct allocator vfs = {
+            dma_allocator_t.alignment,
+            allocate_node,
+            deallocate,
+            owns
+    };
+    memcpy(&dma->vfs, &vfs, sizeof(vfs));
+    dma->numa_node = numa_node;
     return &dma->vfs;
 }
 
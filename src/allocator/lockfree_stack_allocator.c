@@ -0,0 +1,109 @@
+#include <stddef.h>
+#include "log.h"
+#include "allocator.h"
+#include "allocator_common.h"
+
+// marks the end of the free list
+#define LOCKFREE_STACK_EMPTY UINT32_MAX
+
+/*
+ * Treiber stack over entry indices. The free list is threaded through next[], head holds the index of the top entry
+ * in its lower 32 bits and a tag in the upper 32 bits. Every successful CAS increments the tag, so a head that was
+ * popped and pushed again in between (ABA) does not match anymore. A 64 bit CAS is sufficient this way, next[] is
+ * never free'd while the stack is in use, so reading a stale next entry is harmless: the CAS fails.
+ */
+struct lockfree_stack_allocator {
+    struct allocator vfs;
+    struct allocator* parent;
+    void* base_addr;
+    uint32_t entry_size;
+    uint32_t num_entries;
+    // contended cache line, kept away from the read-only fields above
+    uint64_t head __attribute__((aligned(64)));
+    uint32_t next[] __attribute__((aligned(64)));
+};
+
+static inline uint64_t make_head(uint64_t old_head, uint32_t entry_id) {
+    return (((old_head >> 32) + 1) << 32) | entry_id;
+}
+
+static struct mem_blk allocate(struct allocator* a, size_t size) {
+    struct lockfree_stack_allocator* self = container_of(a, struct lockfree_stack_allocator, vfs);
+    if (size > self->entry_size)
+        return (struct mem_blk) {NULL, 0};
+    uint64_t head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+    uint32_t entry_id, next;
+    do {
+        entry_id = (uint32_t) head;
+        if (entry_id == LOCKFREE_STACK_EMPTY)
+            return (struct mem_blk) {NULL, 0};
+        next = __atomic_load_n(&self->next[entry_id], __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&self->head, &head, make_head(head, next), true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    return (struct mem_blk) {((uint8_t*) self->base_addr) + entry_id * self->entry_size, self->entry_size};
+}
+
+static void deallocate(struct allocator* a, struct mem_blk* blk) {
+    static_assert(PTRDIFF_MAX >= UINT32_MAX, "PTRDIFF_MAX < UINT32_MAX");
+    struct lockfree_stack_allocator* self = container_of(a, struct lockfree_stack_allocator, vfs);
+    if (self->entry_size != blk->size)
+        error("Size of returned block (%zu) does not match stack element size (%u)", blk->size, self->entry_size);
+    ptrdiff_t entry_id = (blk->ptr - self->base_addr) / self->entry_size;
+    if (entry_id >= self->num_entries || entry_id < 0)
+        error("Calculated entry id (%lu) is outside of stack range", entry_id);
+    uint64_t head = __atomic_load_n(&self->head, __ATOMIC_RELAXED);
+    do {
+        // the entry is not reachable by other threads until the CAS publishes it
+        __atomic_store_n(&self->next[entry_id], (uint32_t) head, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&self->head, &head, make_head(head, (uint32_t) entry_id), true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#if !defined(NDEBUG)
+    blk->ptr = NULL;
+    blk->size = 0;
+#endif
+}
+
+static bool owns(struct allocator* a, const struct mem_blk* blk) {
+    struct lockfree_stack_allocator* self = container_of(a, struct lockfree_stack_allocator, vfs);
+    return blk->ptr >= self->base_addr && blk->ptr < self->base_addr + self->num_entries * self->entry_size;
+}
+
+struct allocator* lockfree_stack_allocator_new(uint32_t num_entries, uint32_t entry_size, struct allocator* parent) {
+    entry_size = entry_size ? entry_size : 2048;
+    if (num_entries >= LOCKFREE_STACK_EMPTY)
+        error("too many entries for a lock-free stack: %u", num_entries);
+    struct allocator a = {
+            1u,
+            allocate,
+            deallocate,
+            owns
+    };
+    // aligned_alloc() requires the size to be a multiple of the alignment
+    size_t size = (sizeof(struct lockfree_stack_allocator) + sizeof(uint32_t) * num_entries + 63) / 64 * 64;
+    struct lockfree_stack_allocator* sa = aligned_alloc(64, size);
+    if (!sa)
+        return NULL;
+    memcpy(&sa->vfs, &a, sizeof(a));
+
+    sa->parent = parent;
+    struct mem_blk mem = parent->allocate(parent, num_entries * entry_size);
+    if (!mem.ptr)
+        goto error;
+    sa->num_entries = num_entries;
+    sa->entry_size = entry_size;
+    sa->base_addr = mem.ptr;
+    // same order as the other stack allocators: entry 0 is handed out last
+    for (uint32_t i = 0; i < num_entries; i++) {
+        sa->next[i] = i ? i - 1 : LOCKFREE_STACK_EMPTY;
+    }
+    sa->head = num_entries ? num_entries - 1 : LOCKFREE_STACK_EMPTY;
+    return &sa->vfs;
+    error:
+    free(sa);
+    return NULL;
+}
+
+void lockfree_stack_allocator_free(struct allocator* a) {
+    struct lockfree_stack_allocator* self = container_of(a, struct lockfree_stack_allocator, vfs);
+    struct mem_blk blk = {self->base_addr, self->num_entries * self->entry_size};
+    self->parent->deallocate(self->parent, &blk);
+    free(self);
+}
@@ -0,0 +1,238 @@
+#ifndef IXY_POLICY_ALLOCATOR_HPP
+#define IXY_POLICY_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "allocator/allocator.h"
+#include "log.h"
+
+/*
+ * Compile-time counterparts of the allocators in src/allocator. Parents and children are template parameters
+ * instead of struct allocator pointers, so a composition like
+ *
+ *   segregator<256, fallback<stack<256, 512>, mallocator>, mallocator>
+ *
+ * is a single type whose calls inline into straight-line code: no function pointers, and entry sizes and
+ * thresholds are constants. The interface mirrors struct allocator (allocate, deallocate, owns, alignment),
+ * wrap a C allocator with vtable_allocator or c_allocator to use it as a parent, e.g., dma_allocator_t for huge pages.
+ */
+namespace ixy {
+    namespace policy {
+        inline void clear_blk(struct mem_blk* blk) {
+#if !defined(NDEBUG)
+            blk->ptr = nullptr;
+            blk->size = 0;
+#endif
+        }
+
+        /**
+         * malloc/free, same as mallocator_t.
+         */
+        struct mallocator {
+            static constexpr unsigned alignment = alignof(std::max_align_t);
+
+            struct mem_blk allocate(size_t size) {
+                return {std::malloc(size), size};
+            }
+
+            void deallocate(struct mem_blk* blk) {
+                std::free(blk->ptr);
+                clear_blk(blk);
+            }
+
+            bool owns(const struct mem_blk*) const {
+                return true;
+            }
+        };
+
+        /**
+         * Never returns memory, same as null_allocator_t. Ends a chain of fallbacks or an unused segregator side.
+         */
+        struct null_allocator {
+            static constexpr unsigned alignment = ~0u;
+
+            struct mem_blk allocate(size_t) {
+                return {nullptr, 0};
+            }
+
+            void deallocate(struct mem_blk* blk) {
+                if (blk->ptr || blk->size)
+                    error("Attempting to free not NULL blk with null allocator");
+            }
+
+            bool owns(const struct mem_blk*) const {
+                return false;
+            }
+        };
+
+        /**
+         * Any C allocator, calls go through its function pointers. The struct allocator must outlive this.
+         */
+        class vtable_allocator {
+        public:
+            // the alignment of the C allocator is only known at run time
+            static constexpr unsigned alignment = 1u;
+
+            explicit vtable_allocator(struct allocator* a) : a(a) {}
+
+            struct mem_blk allocate(size_t size) {
+                return a->allocate(a, size);
+            }
+
+            void deallocate(struct mem_blk* blk) {
+                a->deallocate(a, blk);
+            }
+
+            bool owns(const struct mem_blk* blk) const {
+                return a->owns(a, blk);
+            }
+
+        private:
+            struct allocator* a;
+        };
+
+        /**
+         * One of the global C allocators, e.g., c_allocator<&dma_allocator_t>. Unlike vtable_allocator this is
+         * default constructible, so it can be the parent of a stack nested in a fallback or segregator.
+         */
+        template<struct allocator* A>
+        struct c_allocator {
+            static constexpr unsigned alignment = 1u;
+
+            struct mem_blk allocate(size_t size) {
+                return A->allocate(A, size);
+            }
+
+            void deallocate(struct mem_blk* blk) {
+                A->deallocate(A, blk);
+            }
+
+            bool owns(const struct mem_blk* blk) const {
+                return A->owns(A, blk);
+            }
+        };
+
+        /**
+         * Stack (LIFO) allocator for fixed sized elements, same as stack_allocator_new(). Not thread-safe.
+         * The memory for all entries is taken from the parent on construction.
+         */
+        template<uint32_t EntrySize, uint32_t NumEntries, typename Parent = mallocator>
+        class stack {
+            static_assert(EntrySize > 0 && NumEntries > 0, "empty stack allocator");
+
+        public:
+            static constexpr unsigned alignment = 1u;
+
+            explicit stack(Parent parent = Parent()) : parent(parent) {
+                mem = this->parent.allocate((size_t) NumEntries * EntrySize);
+                if (!mem.ptr)
+                    error("parent allocator is out of memory");
+                top = NumEntries;
+                for (uint32_t i = 0; i < NumEntries; i++)
+                    free_stack[i] = i;
+            }
+
+            ~stack() {
+                parent.deallocate(&mem);
+            }
+
+            // owns the memory of the entries
+            stack(const stack&) = delete;
+
+            stack& operator=(const stack&) = delete;
+
+            struct mem_blk allocate(size_t size) {
+                if (top == 0 || size > EntrySize)
+                    return {nullptr, 0};
+                return {static_cast<uint8_t*>(mem.ptr) + (size_t) free_stack[--top] * EntrySize, EntrySize};
+            }
+
+            void deallocate(struct mem_blk* blk) {
+                if (blk->size != EntrySize)
+                    error("Size of returned block (%zu) does not match stack element size (%u)", blk->size, EntrySize);
+                ptrdiff_t entry_id = (static_cast<uint8_t*>(blk->ptr) - static_cast<uint8_t*>(mem.ptr)) / EntrySize;
+                if (entry_id >= NumEntries || entry_id < 0)
+                    error("Calculated entry id (%ld) is outside of stack range", entry_id);
+                free_stack[top++] = (uint32_t) entry_id;
+                clear_blk(blk);
+            }
+
+            bool owns(const struct mem_blk* blk) const {
+                return blk->ptr >= mem.ptr && blk->ptr < static_cast<uint8_t*>(mem.ptr) + (size_t) NumEntries * EntrySize;
+            }
+
+        private:
+            Parent parent;
+            struct mem_blk mem;
+            uint32_t top;
+            uint32_t free_stack[NumEntries];
+        };
+
+        /**
+         * Tries Primary first and Secondary if Primary is out of memory, same as fallback_allocator_new().
+         */
+        template<typename Primary, typename Secondary>
+        class fallback {
+        public:
+            static constexpr unsigned alignment = Primary::alignment < Secondary::alignment ? Primary::alignment : Secondary::alignment;
+
+            Primary primary;
+            Secondary secondary;
+
+            struct mem_blk allocate(size_t size) {
+                struct mem_blk blk = primary.allocate(size);
+                if (!blk.ptr)
+                    blk = secondary.allocate(size);
+                return blk;
+            }
+
+            void deallocate(struct mem_blk* blk) {
+                if (primary.owns(blk))
+                    primary.deallocate(blk);
+                else
+                    secondary.deallocate(blk);
+            }
+
+            bool owns(const struct mem_blk* blk) const {
+                return primary.owns(blk) || secondary.owns(blk);
+            }
+        };
+
+        /**
+         * Sends sizes up to Threshold to Small and larger ones to Large. Nest segregators for more size classes,
+         * the comparisons are resolved against constants like the lookup table of segregator_allocator_new().
+         * Deallocation is routed by the size of the block, so Small must not return blocks larger than Threshold.
+         */
+        template<size_t Threshold, typename Small, typename Large>
+        class segregator {
+        public:
+            static constexpr unsigned alignment = Small::alignment < Large::alignment ? Small::alignment : Large::alignment;
+
+            Small small;
+            Large large;
+
+            struct mem_blk allocate(size_t size) {
+                if (size <= Threshold)
+                    return small.allocate(size);
+                return large.allocate(size);
+            }
+
+            void deallocate(struct mem_blk* blk) {
+                if (blk->size <= Threshold)
+                    small.deallocate(blk);
+                else
+                    large.deallocate(blk);
+            }
+
+            bool owns(const struct mem_blk* blk) const {
+                if (blk->size <= Threshold)
+                    return small.owns(blk);
+                return large.owns(blk);
+            }
+        };
+    }
+}
+
+#endif //IXY_POLICY_ALLOCATOR_HPP
@@ -0,0 +1,109 @@
+#ifndef _RTE_MCSLOCK_H_
+#define _RTE_MCSLOCK_H_
+
+/**
+ * @file
+ *
+ * MCS locks
+ *
+ * An MCS lock is a fair queued spinlock: every thread brings its own queue
+ * node (usually on its stack) and spins on a flag in that node only. A release
+ * writes to the node of the next waiter, so handing over the lock touches one
+ * remote cache line no matter how many threads are waiting. This scales
+ * better than rte_spinlock_t and rte_ticketlock_t on large sockets.
+ *
+ * The lock itself is a pointer to the tail of the queue, NULL if unlocked.
+ * The node passed to rte_mcslock_lock() must stay valid until the matching
+ * rte_mcslock_unlock().
+ *
+ */
+
+#include <stddef.h>
+#include <emmintrin.h>
+
+/**
+ * The rte_mcslock_t type, a node in the queue of waiting threads.
+ */
+typedef struct rte_mcslock {
+	struct rte_mcslock *next;
+	int locked; /**< 1 while the owner of the node waits for the lock */
+} rte_mcslock_t;
+
+/**
+ * Take the MCS lock.
+ *
+ * @param msl
+ *   A pointer to the lock, i.e., to the pointer to the tail of the queue.
+ * @param me
+ *   A pointer to the queue node of the calling thread.
+ */
+static inline void
+rte_mcslock_lock(rte_mcslock_t **msl, rte_mcslock_t *me)
+{
+	me->locked = 1;
+	me->next = NULL;
+	rte_mcslock_t *prev = __atomic_exchange_n(msl, me, __ATOMIC_ACQ_REL);
+	if (prev == NULL)
+		return;
+	// queue up behind the previous tail and wait until it hands over the lock
+	__atomic_store_n(&prev->next, me, __ATOMIC_RELEASE);
+	while (__atomic_load_n(&me->locked, __ATOMIC_ACQUIRE))
+		_mm_pause();
+}
+
+/**
+ * Release the MCS lock.
+ *
+ * @param msl
+ *   A pointer to the lock.
+ * @param me
+ *   A pointer to the queue node that was used to take the lock.
+ */
+static inline void
+rte_mcslock_unlock(rte_mcslock_t **msl, rte_mcslock_t *me)
+{
+	if (__atomic_load_n(&me->next, __ATOMIC_RELAXED) == NULL) {
+		rte_mcslock_t *save_me = me;
+		// no known successor: try to set the lock back to unlocked
+		if (__atomic_compare_exchange_n(msl, &save_me, NULL, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return;
+		// a thread is just queueing up behind us, wait until it has linked its node
+		while (__atomic_load_n(&me->next, __ATOMIC_ACQUIRE) == NULL)
+			_mm_pause();
+	}
+	__atomic_store_n(&me->next->locked, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Try to take the lock.
+ *
+ * @param msl
+ *   A pointer to the lock.
+ * @param me
+ *   A pointer to the queue node of the calling thread.
+ * @return
+ *   1 if the lock is successfully taken; 0 otherwise.
+ */
+static inline int
+rte_mcslock_trylock(rte_mcslock_t **msl, rte_mcslock_t *me)
+{
+	me->next = NULL;
+	rte_mcslock_t *expected = NULL;
+	return __atomic_compare_exchange_n(msl, &expected, me, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+/**
+ * Test if the lock is taken.
+ *
+ * @param msl
+ *   A pointer to the lock.
+ * @return
+ *   1 if the lock is currently taken; 0 otherwise.
+ */
+static inline int
+rte_mcslock_is_locked(rte_mcslock_t **msl)
+{
+	return __atomic_load_n(msl, __ATOMIC_RELAXED) != NULL;
+}
+
+#endif /* _RTE_MCSLOCK_H_ */
@@ -0,0 +1,92 @@
+#ifndef _RTE_RTM_H_
+#define _RTE_RTM_H_
+
+/**
+ * @file
+ *
+ * Restricted Transactional Memory (Intel TSX)
+ *
+ * The instructions are emitted as raw bytes so that this header builds with
+ * compilers and -march settings that do not enable RTM. Only execute them if
+ * rte_rtm_supported() returned 1.
+ *
+ */
+
+#include <cpuid.h>
+
+#define RTE_XBEGIN_STARTED		(~0u)
+#define RTE_XABORT_EXPLICIT		(1 << 0)
+#define RTE_XABORT_RETRY		(1 << 1)
+#define RTE_XABORT_CONFLICT		(1 << 2)
+#define RTE_XABORT_CAPACITY		(1 << 3)
+#define RTE_XABORT_DEBUG		(1 << 4)
+#define RTE_XABORT_NESTED		(1 << 5)
+#define RTE_XABORT_CODE(x)		(((x) >> 24) & 0xff)
+
+/**
+ * Check if the CPU supports RTM, the result is cached after the first call.
+ *
+ * @return
+ *   1 if RTM is available; 0 otherwise.
+ */
+static inline int
+rte_rtm_supported(void)
+{
+	static int supported = -1;
+	int cached = __atomic_load_n(&supported, __ATOMIC_RELAXED);
+	if (cached >= 0)
+		return cached;
+	unsigned int eax, ebx, ecx, edx;
+	// structured extended feature flags, RTM is reported in bit 11 of ebx
+	cached = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_RTM);
+	__atomic_store_n(&supported, cached, __ATOMIC_RELAXED);
+	return cached;
+}
+
+/**
+ * Start a transaction.
+ *
+ * @return
+ *   RTE_XBEGIN_STARTED when the transaction started, the abort status
+ *   (RTE_XABORT_* flags) when it aborted.
+ */
+static __attribute__((__always_inline__)) inline unsigned int
+rte_xbegin(void)
+{
+	unsigned int ret = RTE_XBEGIN_STARTED;
+	asm volatile(".byte 0xc7,0xf8 ; .long 0" : "+a" (ret) :: "memory");
+	return ret;
+}
+
+/**
+ * Commit the current transaction.
+ */
+static __attribute__((__always_inline__)) inline void
+rte_xend(void)
+{
+	asm volatile(".byte 0x0f,0x01,0xd5" ::: "memory");
+}
+
+/**
+ * Abort the current transaction, the status code must be a constant.
+ * A macro instead of a function because the code is an immediate operand.
+ */
+#define rte_xabort(status) do { \
+	asm volatile(".byte 0xc6,0xf8,%P0" :: "i" (status) : "memory"); \
+} while (0)
+
+/**
+ * Check if the calling thread runs in a transaction.
+ *
+ * @return
+ *   1 if in a transaction; 0 otherwise.
+ */
+static __attribute__((__always_inline__)) inline int
+rte_xtest(void)
+{
+	unsigned char out;
+	asm volatile(".byte 0x0f,0x01,0xd6 ; setnz %0" : "=r" (out) :: "memory");
+	return out;
+}
+
+#endif /* _RTE_RTM_H_ */
@@ -50,7 +50,9 @@
 #include "rte_per_lcore.h"
 #include <sys/types.h>
 #include <emmintrin.h>
+#include <x86intrin.h>
 #include <syscall.h>
+#include "rte_rtm.h"
 
 /* require calling thread tid by gettid() */
 static inline int rte_sys_gettid(void)
@@ -151,6 +153,112 @@ static inline int rte_spinlock_is_locked (rte_spinlock_t *sl)
 	return sl->locked;
 }
 
+#define RTE_RTM_MAX_RETRIES (20)
+#define RTE_XABORT_LOCK_BUSY (0xff)
+
+/**
+ * Try to elide the lock: start a transaction that only reads the lock.
+ * Returns 1 in a running transaction with the lock free, 0 if the caller
+ * has to take the lock for real (no RTM, lock busy or too many aborts).
+ * With wait set, a busy lock is waited for and the transaction retried;
+ * without it, 0 is returned as soon as the lock is seen busy, the trylock
+ * variants must not spin on a lock held by someone else.
+ */
+static inline int
+rte_try_tm(volatile int *lock, int wait)
+{
+	int i, retries;
+
+	if (!rte_rtm_supported())
+		return 0;
+
+	retries = RTE_RTM_MAX_RETRIES;
+
+	while (retries--) {
+		unsigned int status = rte_xbegin();
+
+		if (status == RTE_XBEGIN_STARTED) {
+			// the lock is now in our read set, a thread taking it aborts us
+			if (*lock)
+				rte_xabort(RTE_XABORT_LOCK_BUSY);
+			else
+				return 1;
+		}
+		if (!wait && *lock)
+			return 0;
+		while (*lock)
+			_mm_pause();
+
+		if ((status & RTE_XABORT_CONFLICT) ||
+		   ((status & RTE_XABORT_EXPLICIT) &&
+		    (RTE_XABORT_CODE(status) == RTE_XABORT_LOCK_BUSY))) {
+			// randomized exponential back-off before retrying
+			int try_count = RTE_RTM_MAX_RETRIES - retries;
+			int pause_count = (__rdtsc() & 0x7) | 1;
+			pause_count <<= try_count;
+			for (i = 0; i < pause_count; i++)
+				_mm_pause();
+			continue;
+		}
+
+		if ((status & RTE_XABORT_RETRY) == 0) /* do not retry */
+			break;
+	}
+	return 0;
+}
+
+/**
+ * Take the spinlock, or elide it with a hardware memory transaction if the
+ * CPU supports RTM. Falls back to rte_spinlock_lock() otherwise or if the
+ * transaction keeps aborting. Only suitable for short critical sections
+ * without system calls or I/O, those always abort the transaction.
+ *
+ * @param sl
+ *   A pointer to the spinlock.
+ */
+static inline void
+rte_spinlock_lock_tm(rte_spinlock_t *sl)
+{
+	if (rte_try_tm(&sl->locked, 1))
+		return;
+
+	rte_spinlock_lock(sl); /* fall-back */
+}
+
+/**
+ * Try to take the spinlock, or elide it with a hardware memory transaction.
+ *
+ * @param sl
+ *   A pointer to the spinlock.
+ * @return
+ *   1 if the lock is successfully taken or elided; 0 otherwise.
+ */
+static inline int
+rte_spinlock_trylock_tm(rte_spinlock_t *sl)
+{
+	if (rte_try_tm(&sl->locked, 0))
+		return 1;
+
+	return rte_spinlock_trylock(sl);
+}
+
+/**
+ * Release a spinlock taken with rte_spinlock_lock_tm() or
+ * rte_spinlock_trylock_tm(): commits the transaction if the lock was
+ * elided, releases the lock otherwise.
+ *
+ * @param sl
+ *   A pointer to the spinlock.
+ */
+static inline void
+rte_spinlock_unlock_tm(rte_spinlock_t *sl)
+{
+	if (sl->locked)
+		rte_spinlock_unlock(sl);
+	else
+		rte_xend();
+}
+
 /**
  * The rte_spinlock_recursive_t type.
  */
@@ -231,4 +339,53 @@ static inline int rte_spinlock_recursive_trylock(rte_spinlock_recursive_t *slr)
 	return 1;
 }
 
+/**
+ * Take the recursive spinlock, or elide it with a hardware memory
+ * transaction if the CPU supports RTM. A lock the calling thread already
+ * holds is never elided, it is taken recursively.
+ *
+ * @param slr
+ *   A pointer to the recursive spinlock.
+ */
+static inline void rte_spinlock_recursive_lock_tm(rte_spinlock_recursive_t *slr)
+{
+	// waiting for a lock held by this thread would never end
+	if (slr->user != rte_gettid() && rte_try_tm(&slr->sl.locked, 1))
+		return;
+
+	rte_spinlock_recursive_lock(slr); /* fall-back */
+}
+
+/**
+ * Release a recursive spinlock taken with rte_spinlock_recursive_lock_tm()
+ * or rte_spinlock_recursive_trylock_tm().
+ *
+ * @param slr
+ *   A pointer to the recursive spinlock.
+ */
+static inline void rte_spinlock_recursive_unlock_tm(rte_spinlock_recursive_t *slr)
+{
+	if (slr->sl.locked)
+		rte_spinlock_recursive_unlock(slr);
+	else
+		rte_xend();
+}
+
+/**
+ * Try to take the recursive lock, or elide it with a hardware memory
+ * transaction.
+ *
+ * @param slr
+ *   A pointer to the recursive spinlock.
+ * @return
+ *   1 if the lock is successfully taken or elided; 0 otherwise.
+ */
+static inline int rte_spinlock_recursive_trylock_tm(rte_spinlock_recursive_t *slr)
+{
+	if (slr->user != rte_gettid() && rte_try_tm(&slr->sl.locked, 0))
+		return 1;
+
+	return rte_spinlock_recursive_trylock(slr);
+}
+
 #endif /* _RTE_SPINLOCK_H_ */
@@ -0,0 +1,114 @@
+#ifndef _RTE_TICKETLOCK_H_
+#define _RTE_TICKETLOCK_H_
+
+/**
+ * @file
+ *
+ * Ticket locks, same API as rte_spinlock.h
+ *
+ * A ticket lock is a fair spinlock: threads take a ticket number and are
+ * served in the order of their tickets, so no thread starves under contention.
+ * Waiting threads only read the lock word, the cache line is written once per
+ * lock and once per unlock instead of on every attempt as for rte_spinlock_t.
+ *
+ * All locks must be initialised before use, and only initialised once.
+ *
+ */
+
+#include <stdint.h>
+#include <emmintrin.h>
+
+/**
+ * The rte_ticketlock_t type.
+ */
+typedef union {
+	uint32_t tickets;
+	struct {
+		uint16_t current; /**< ticket that is currently served */
+		uint16_t next; /**< ticket handed out to the next thread */
+	} s;
+} rte_ticketlock_t;
+
+/**
+ * A static ticketlock initializer.
+ */
+#define RTE_TICKETLOCK_INITIALIZER { 0 }
+
+/**
+ * Initialize the ticketlock to an unlocked state.
+ *
+ * @param tl
+ *   A pointer to the ticketlock.
+ */
+static inline void
+rte_ticketlock_init(rte_ticketlock_t *tl)
+{
+	__atomic_store_n(&tl->tickets, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Take the ticketlock.
+ *
+ * @param tl
+ *   A pointer to the ticketlock.
+ */
+static inline void
+rte_ticketlock_lock(rte_ticketlock_t *tl)
+{
+	uint16_t me = __atomic_fetch_add(&tl->s.next, 1, __ATOMIC_RELAXED);
+	while (__atomic_load_n(&tl->s.current, __ATOMIC_ACQUIRE) != me)
+		_mm_pause();
+}
+
+/**
+ * Release the ticketlock.
+ *
+ * @param tl
+ *   A pointer to the ticketlock.
+ */
+static inline void
+rte_ticketlock_unlock(rte_ticketlock_t *tl)
+{
+	uint16_t i = __atomic_load_n(&tl->s.current, __ATOMIC_RELAXED);
+	__atomic_store_n(&tl->s.current, (uint16_t) (i + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * Try to take the lock.
+ *
+ * @param tl
+ *   A pointer to the ticketlock.
+ * @return
+ *   1 if the lock is successfully taken; 0 otherwise.
+ */
+static inline int
+rte_ticketlock_trylock(rte_ticketlock_t *tl)
+{
+	rte_ticketlock_t old, new;
+	old.tickets = __atomic_load_n(&tl->tickets, __ATOMIC_RELAXED);
+	new.tickets = old.tickets;
+	new.s.next++;
+	if (old.s.next == old.s.current) {
+		if (__atomic_compare_exchange_n(&tl->tickets, &old.tickets, new.tickets, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Test if the lock is taken.
+ *
+ * @param tl
+ *   A pointer to the ticketlock.
+ * @return
+ *   1 if the lock is currently taken; 0 otherwise.
+ */
+static inline int
+rte_ticketlock_is_locked(rte_ticketlock_t *tl)
+{
+	rte_ticketlock_t tic;
+	tic.tickets = __atomic_load_n(&tl->tickets, __ATOMIC_ACQUIRE);
+	return tic.s.current != tic.s.next;
+}
+
+#endif /* _RTE_TICKETLOCK_H_ */
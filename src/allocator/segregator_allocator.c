@@ -0,0 +1,101 @@
+#include "allocator.h"
+#include "allocator_common.h"
+
+#include "log.h"
+
+// upper limit for the size of the lookup table
+#define SEGREGATOR_MAX_LOOKUP_ENTRIES (1u << 20)
+
+/*
+ * Requests are mapped to their class with a single table lookup: sizes are rounded up to the granularity, the
+ * largest power of two that divides all class sizes, so every table entry belongs to exactly one class.
+ */
+struct segregator_allocator {
+    struct allocator self;
+    struct allocator* large;
+    size_t max_class_size;
+    uint32_t granularity_shift;
+    uint32_t num_classes;
+    struct allocator** children;
+    // class of (size + granularity - 1) >> granularity_shift
+    uint8_t lookup[];
+};
+
+static inline struct allocator* segregator_route(struct segregator_allocator* self, size_t size) {
+    if (size > self->max_class_size)
+        return self->large;
+    return self->children[self->lookup[(size + (1ul << self->granularity_shift) - 1) >> self->granularity_shift]];
+}
+
+static struct mem_blk segregator_allocator_allocate(struct allocator* a, size_t size) {
+    struct segregator_allocator* self = container_of(a, struct segregator_allocator, self);
+    struct allocator* child = segregator_route(self, size);
+    if (!child)
+        return (struct mem_blk) {NULL, 0};
+    return child->allocate(child, size);
+}
+
+static void segregator_allocator_deallocate(struct allocator* a, struct mem_blk* blk) {
+    struct segregator_allocator* self = container_of(a, struct segregator_allocator, self);
+    struct allocator* child = segregator_route(self, blk->size);
+    if (!child)
+        error("Size of returned block (%zu) is larger than the largest size class (%zu)", blk->size, self->max_class_size);
+    child->deallocate(child, blk);
+}
+
+static bool segregator_allocator_owns(struct allocator* a, const struct mem_blk* blk) {
+    struct segregator_allocator* self = container_of(a, struct segregator_allocator, self);
+    struct allocator* child = segregator_route(self, blk->size);
+    return child && child->owns(child, blk);
+}
+
+struct allocator* segregator_allocator_new(const size_t* class_sizes, struct allocator* const* children, uint32_t num_classes, struct allocator* large) {
+    if (num_classes == 0 || num_classes > UINT8_MAX)
+        error("number of size classes must be between 1 and %u, got %u", UINT8_MAX, num_classes);
+    unsigned alignment = large ? large->alignment : ~0u;
+    size_t size_bits = 0;
+    for (uint32_t i = 0; i < num_classes; i++) {
+        if (!class_sizes[i] || (i && class_sizes[i] <= class_sizes[i - 1]))
+            error("size classes must be positive and strictly increasing, class %u has size %zu", i, class_sizes[i]);
+        alignment = min(alignment, children[i]->alignment);
+        size_bits |= class_sizes[i];
+    }
+    uint32_t granularity_shift = (uint32_t) __builtin_ctzl(size_bits);
+    size_t max_class_size = class_sizes[num_classes - 1];
+    size_t num_lookup = (max_class_size >> granularity_shift) + 1;
+    if (num_lookup > SEGREGATOR_MAX_LOOKUP_ENTRIES)
+        error("size classes need a lookup table with %zu entries, use sizes with a common power of two factor", num_lookup);
+    struct allocator a = {
+            alignment,
+            segregator_allocator_allocate,
+            segregator_allocator_deallocate,
+            segregator_allocator_owns,
+    };
+    struct segregator_allocator* sa = malloc(sizeof(*sa) + num_lookup);
+    if (!sa)
+        return NULL;
+    sa->children = malloc(sizeof(*sa->children) * num_classes);
+    if (!sa->children) {
+        free(sa);
+        return NULL;
+    }
+    memcpy(&sa->self, &a, sizeof(a));
+    sa->large = large;
+    sa->max_class_size = max_class_size;
+    sa->granularity_shift = granularity_shift;
+    sa->num_classes = num_classes;
+    memcpy(sa->children, children, sizeof(*sa->children) * num_classes);
+    uint32_t cls = 0;
+    for (size_t i = 0; i < num_lookup; i++) {
+        if ((i << granularity_shift) > class_sizes[cls])
+            cls++;
+        sa->lookup[i] = (uint8_t) cls;
+    }
+    return &sa->self;
+}
+
+void segregator_allocator_free(struct allocator* a) {
+    struct segregator_allocator* self = container_of(a, struct segregator_allocator, self);
+    free(self->children);
+    free(self);
+}
@@ -3,11 +3,21 @@
 #include "allocator.h"
 #include "allocator_common.h"
 #include "rte_spinlock.h"
+#include "rte_ticketlock.h"
+#include "rte_mcslock.h"
+
+union stack_lock {
+    rte_spinlock_t spinlock;
+    rte_ticketlock_t ticketlock;
+    // tail of the queue of waiting threads, the nodes live on the stacks of the threads
+    rte_mcslock_t* mcslock;
+};
 
 struct spinlock_stack_allocator {
     struct allocator vfs;
     struct allocator* parent;
-    rte_spinlock_t lock;
+    enum stack_lock_type lock_type;
+    union stack_lock lock;
     void* base_addr;
     uintptr_t base_addr_phy;
     uint32_t entry_size;
@@ -16,43 +26,119 @@ struct spinlock_stack_allocator {
     uint32_t free_stack[];
 };
 
-static struct mem_blk allocate(struct allocator* a, size_t size) {
-    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
-    rte_spinlock_lock(&self->lock);
-    struct mem_blk blk;
+// the stack operations themselves, to be called with the lock held
+
+static inline struct mem_blk pop(struct spinlock_stack_allocator* self, size_t size) {
     if (self->free_stack_top == 0 || size > self->entry_size)
-        blk = (struct mem_blk) {NULL, 0};
-    else {
-        uint32_t entry_id = self->free_stack[--self->free_stack_top];
-        blk = (struct mem_blk) {((uint8_t*) self->base_addr) + entry_id * self->entry_size, self->entry_size};
-    }
-    rte_spinlock_unlock(&self->lock);
-    return blk;
+        return (struct mem_blk) {NULL, 0};
+    uint32_t entry_id = self->free_stack[--self->free_stack_top];
+    return (struct mem_blk) {((uint8_t*) self->base_addr) + entry_id * self->entry_size, self->entry_size};
 }
 
-static void deallocate(struct allocator* a, struct mem_blk* blk) {
+static inline void push(struct spinlock_stack_allocator* self, uint32_t entry_id) {
+    self->free_stack[self->free_stack_top++] = entry_id;
+}
+
+// validates a returned block, this does not need the lock
+static inline uint32_t entry_id_of(struct spinlock_stack_allocator* self, struct mem_blk* blk) {
     static_assert(PTRDIFF_MAX >= UINT32_MAX, "PTRDIFF_MAX < UINT32_MAX");
-    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
     if (self->entry_size != blk->size)
         error("Size of returned block (%zu) does not match stack element size (%u)", blk->size, self->entry_size);
     ptrdiff_t entry_id = (blk->ptr - self->base_addr) / self->entry_size;
-    if (entry_id > self->num_entries || entry_id < 0)
+    if (entry_id >= self->num_entries || entry_id < 0)
         error("Calculated entry id (%lu) is outside of stack range", entry_id);
-    rte_spinlock_lock(&self->lock);
-    self->free_stack[self->free_stack_top++] = (uint32_t) entry_id;
-    rte_spinlock_unlock(&self->lock);
+    return (uint32_t) entry_id;
+}
+
+static inline void clear_blk(struct mem_blk* blk) {
 #if !defined(NDEBUG)
     blk->ptr = NULL;
     blk->size = 0;
 #endif
 }
 
+// one allocate/deallocate pair per lock type, so that the lock calls are inlined
+
+static struct mem_blk allocate(struct allocator* a, size_t size) {
+    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
+    rte_spinlock_lock(&self->lock.spinlock);
+    struct mem_blk blk = pop(self, size);
+    rte_spinlock_unlock(&self->lock.spinlock);
+    return blk;
+}
+
+static void deallocate(struct allocator* a, struct mem_blk* blk) {
+    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
+    uint32_t entry_id = entry_id_of(self, blk);
+    rte_spinlock_lock(&self->lock.spinlock);
+    push(self, entry_id);
+    rte_spinlock_unlock(&self->lock.spinlock);
+    clear_blk(blk);
+}
+
+// push/pop only touch the stack top and one array slot, short enough to run in a hardware transaction
+static struct mem_blk allocate_tm(struct allocator* a, size_t size) {
+    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
+    rte_spinlock_lock_tm(&self->lock.spinlock);
+    struct mem_blk blk = pop(self, size);
+    rte_spinlock_unlock_tm(&self->lock.spinlock);
+    return blk;
+}
+
+static void deallocate_tm(struct allocator* a, struct mem_blk* blk) {
+    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
+    uint32_t entry_id = entry_id_of(self, blk);
+    rte_spinlock_lock_tm(&self->lock.spinlock);
+    push(self, entry_id);
+    rte_spinlock_unlock_tm(&self->lock.spinlock);
+    clear_blk(blk);
+}
+
+static struct mem_blk allocate_ticketlock(struct allocator* a, size_t size) {
+    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
+    rte_ticketlock_lock(&self->lock.ticketlock);
+    struct mem_blk blk = pop(self, size);
+    rte_ticketlock_unlock(&self->lock.ticketlock);
+    return blk;
+}
+
+static void deallocate_ticketlock(struct allocator* a, struct mem_blk* blk) {
+    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
+    uint32_t entry_id = entry_id_of(self, blk);
+    rte_ticketlock_lock(&self->lock.ticketlock);
+    push(self, entry_id);
+    rte_ticketlock_unlock(&self->lock.ticketlock);
+    clear_blk(blk);
+}
+
+static struct mem_blk allocate_mcslock(struct allocator* a, size_t size) {
+    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
+    rte_mcslock_t node;
+    rte_mcslock_lock(&self->lock.mcslock, &node);
+    struct mem_blk blk = pop(self, size);
+    rte_mcslock_unlock(&self->lock.mcslock, &node);
+    return blk;
+}
+
+static void deallocate_mcslock(struct allocator* a, struct mem_blk* blk) {
+    struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
+    uint32_t entry_id = entry_id_of(self, blk);
+    rte_mcslock_t node;
+    rte_mcslock_lock(&self->lock.mcslock, &node);
+    push(self, entry_id);
+    rte_mcslock_unlock(&self->lock.mcslock, &node);
+    clear_blk(blk);
+}
+
 static bool owns(struct allocator* a, const struct mem_blk* blk) {
     struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
     return blk->ptr >= self->base_addr && blk->ptr < self->base_addr + self->num_entries * self->entry_size;
 }
 
-struct allocator* spinlock_stack_allocator_new(uint32_t num_entries, uint32_t entry_size, struct allocator* parent) {
+// set once the missing RTM support was logged
+static bool rtm_warned;
+
+struct allocator* spinlock_stack_allocator_new_lock(uint32_t num_entries, uint32_t entry_size, struct allocator* parent, enum stack_lock_type lock_type) {
     entry_size = entry_size ? entry_size : 2048;
     struct allocator a = {
             1u,
@@ -60,13 +146,46 @@ struct allocator* spinlock_stack_allocator_new(uint32_t num_entries, uint32_t en
             deallocate,
             owns
     };
+    switch (lock_type) {
+        case STACK_LOCK_SPINLOCK:
+            break;
+        case STACK_LOCK_SPINLOCK_TM:
+            // once per process, allocators are created per queue or flow table
+            if (!rte_rtm_supported() && !__atomic_exchange_n(&rtm_warned, true, __ATOMIC_RELAXED))
+                warn("RTM not supported, the stack locks of STACK_LOCK_SPINLOCK_TM allocators are not elided");
+            a.allocate = allocate_tm;
+            a.deallocate = deallocate_tm;
+            break;
+        case STACK_LOCK_TICKETLOCK:
+            a.allocate = allocate_ticketlock;
+            a.deallocate = deallocate_ticketlock;
+            break;
+        case STACK_LOCK_MCSLOCK:
+            a.allocate = allocate_mcslock;
+            a.deallocate = deallocate_mcslock;
+            break;
+        default:
+            error("unknown lock type %d", lock_type);
+    }
     struct spinlock_stack_allocator* sa = malloc(sizeof(*sa) + sizeof(uint32_t) * num_entries);
     if (!sa)
         return NULL;
     memcpy(&sa->vfs, &a, sizeof(a));
 
     sa->parent = parent;
-    rte_spinlock_init(&sa->lock);
+    sa->lock_type = lock_type;
+    switch (lock_type) {
+        case STACK_LOCK_SPINLOCK:
+        case STACK_LOCK_SPINLOCK_TM:
+            rte_spinlock_init(&sa->lock.spinlock);
+            break;
+        case STACK_LOCK_TICKETLOCK:
+            rte_ticketlock_init(&sa->lock.ticketlock);
+            break;
+        case STACK_LOCK_MCSLOCK:
+            sa->lock.mcslock = NULL;
+            break;
+    }
     struct mem_blk mem = parent->allocate(parent, num_entries * entry_size);
     if (!mem.ptr)
         goto error;
@@ -83,11 +202,27 @@ struct allocator* spinlock_stack_allocator_new(uint32_t num_entries, uint32_t en
     return NULL;
 }
 
+struct allocator* spinlock_stack_allocator_new(uint32_t num_entries, uint32_t entry_size, struct allocator* parent) {
+    return spinlock_stack_allocator_new_lock(num_entries, entry_size, parent, STACK_LOCK_SPINLOCK);
+}
+
 void spinlock_stack_allocator_free(struct allocator* a) {
     struct spinlock_stack_allocator* self = container_of(a, struct spinlock_stack_allocator, vfs);
-    rte_spinlock_lock(&self->lock);
     struct mem_blk blk = {self->base_addr, self->num_entries * self->entry_size};
+    // waits for threads that are still in a critical section
+    rte_mcslock_t node;
+    switch (self->lock_type) {
+        case STACK_LOCK_SPINLOCK:
+        case STACK_LOCK_SPINLOCK_TM:
+            rte_spinlock_lock(&self->lock.spinlock);
+            break;
+        case STACK_LOCK_TICKETLOCK:
+            rte_ticketlock_lock(&self->lock.ticketlock);
+            break;
+        case STACK_LOCK_MCSLOCK:
+            rte_mcslock_lock(&self->lock.mcslock, &node);
+            break;
+    }
     self->parent->deallocate(self->parent, &blk);
-    rte_spinlock_unlock(&self->lock);
     free(self);
 }
@@ -28,7 +28,7 @@ static void stack_allocator_deallocate(struct allocator* a, struct mem_blk* blk)
     if (self->entry_size != blk->size)
         error("Size of returned block (%zu) does not match stack element size (%u)", blk->size, self->entry_size);
     ptrdiff_t entry_id = (blk->ptr - self->base_addr) / self->entry_size;
-    if (entry_id > self->num_entries || entry_id < 0)
+    if (entry_id >= self->num_entries || entry_id < 0)
         error("Calculated entry id (%lu) is outside of stack range", entry_id);
     self->free_stack[self->free_stack_top++] = (uint32_t) entry_id;
 #if !defined(NDEBUG)
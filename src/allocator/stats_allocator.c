@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include "allocator.h"
+#include "allocator_common.h"
+#include "rte_per_lcore.h"
+
+/*
+ * Every thread counts in its own cache line, so counting is a few plain adds and stores without any atomic
+ * read-modify-write or cache line bouncing. Threads get a slot number on their first operation on any stats
+ * allocator; threads beyond STATS_ALLOCATOR_MAX_THREADS share an overflow slot that is updated atomically.
+ */
+struct stats_slot {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t failures;
+    uint64_t bytes_allocated;
+    uint64_t bytes_freed;
+    uint64_t max_bytes_in_use;
+} __attribute__((aligned(64)));
+
+struct stats_allocator {
+    struct allocator vfs;
+    struct allocator* parent;
+    // highest aggregated number of bytes in use seen by stats_allocator_read()
+    uint64_t max_bytes_in_use;
+    struct stats_slot slots[STATS_ALLOCATOR_MAX_THREADS + 1];
+};
+
+#define STATS_SLOT_OVERFLOW STATS_ALLOCATOR_MAX_THREADS
+
+static uint32_t next_thread_slot;
+static RTE_DEFINE_PER_LCORE(uint32_t, thread_slot) = UINT32_MAX;
+
+uint32_t stats_allocator_thread_slot() {
+    if (RTE_PER_LCORE(thread_slot) == UINT32_MAX) {
+        uint32_t slot = __atomic_fetch_add(&next_thread_slot, 1, __ATOMIC_RELAXED);
+        RTE_PER_LCORE(thread_slot) = slot < STATS_SLOT_OVERFLOW ? slot : STATS_SLOT_OVERFLOW;
+    }
+    return RTE_PER_LCORE(thread_slot);
+}
+
+// only the owning thread writes its slot, readers may see slightly outdated values but never torn ones
+static inline void slot_add(uint64_t* counter, uint64_t value, bool shared) {
+    if (shared)
+        __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+    else
+        __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static struct mem_blk allocate(struct allocator* a, size_t size) {
+    struct stats_allocator* self = container_of(a, struct stats_allocator, vfs);
+    struct mem_blk blk = self->parent->allocate(self->parent, size);
+    uint32_t slot_id = stats_allocator_thread_slot();
+    struct stats_slot* slot = &self->slots[slot_id];
+    bool shared = slot_id == STATS_SLOT_OVERFLOW;
+    if (!blk.ptr) {
+        slot_add(&slot->failures, 1, shared);
+        return blk;
+    }
+    slot_add(&slot->allocations, 1, shared);
+    slot_add(&slot->bytes_allocated, blk.size, shared);
+    // high-water mark of the memory held by this thread, not meaningful for blocks that are free'd by other threads
+    uint64_t in_use = slot->bytes_allocated - slot->bytes_freed;
+    if (!shared && (int64_t) in_use > (int64_t) slot->max_bytes_in_use)
+        __atomic_store_n(&slot->max_bytes_in_use, in_use, __ATOMIC_RELAXED);
+    return blk;
+}
+
+static void deallocate(struct allocator* a, struct mem_blk* blk) {
+    struct stats_allocator* self = container_of(a, struct stats_allocator, vfs);
+    size_t size = blk->size;
+    self->parent->deallocate(self->parent, blk);
+    uint32_t slot_id = stats_allocator_thread_slot();
+    struct stats_slot* slot = &self->slots[slot_id];
+    bool shared = slot_id == STATS_SLOT_OVERFLOW;
+    slot_add(&slot->frees, 1, shared);
+    slot_add(&slot->bytes_freed, size, shared);
+}
+
+static bool owns(struct allocator* a, const struct mem_blk* blk) {
+    struct stats_allocator* self = container_of(a, struct stats_allocator, vfs);
+    return self->parent->owns(self->parent, blk);
+}
+
+static void read_slot(const struct stats_slot* slot, struct allocator_stats* stats) {
+    stats->allocations = __atomic_load_n(&slot->allocations, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&slot->frees, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&slot->failures, __ATOMIC_RELAXED);
+    stats->bytes_allocated = __atomic_load_n(&slot->bytes_allocated, __ATOMIC_RELAXED);
+    stats->bytes_freed = __atomic_load_n(&slot->bytes_freed, __ATOMIC_RELAXED);
+    stats->bytes_in_use = (int64_t) (stats->bytes_allocated - stats->bytes_freed);
+    stats->max_bytes_in_use = __atomic_load_n(&slot->max_bytes_in_use, __ATOMIC_RELAXED);
+}
+
+struct allocator* stats_allocator_new(struct allocator* parent) {
+    struct allocator a = {
+            parent->alignment,
+            allocate,
+            deallocate,
+            owns
+    };
+    struct stats_allocator* sa = aligned_alloc(64, sizeof(*sa));
+    if (!sa)
+        return NULL;
+    memset(sa, 0, sizeof(*sa));
+    memcpy(&sa->vfs, &a, sizeof(a));
+    sa->parent = parent;
+    return &sa->vfs;
+}
+
+void stats_allocator_read(struct allocator* a, struct allocator_stats* stats) {
+    struct stats_allocator* self = container_of(a, struct stats_allocator, vfs);
+    memset(stats, 0, sizeof(*stats));
+    for (uint32_t i = 0; i <= STATS_ALLOCATOR_MAX_THREADS; i++) {
+        struct allocator_stats slot;
+        read_slot(&self->slots[i], &slot);
+        stats->allocations += slot.allocations;
+        stats->frees += slot.frees;
+        stats->failures += slot.failures;
+        stats->bytes_allocated += slot.bytes_allocated;
+        stats->bytes_freed += slot.bytes_freed;
+    }
+    stats->bytes_in_use = (int64_t) (stats->bytes_allocated - stats->bytes_freed);
+    uint64_t max = __atomic_load_n(&self->max_bytes_in_use, __ATOMIC_RELAXED);
+    while (stats->bytes_in_use > (int64_t) max
+           && !__atomic_compare_exchange_n(&self->max_bytes_in_use, &max, (uint64_t) stats->bytes_in_use, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    stats->max_bytes_in_use = max > (uint64_t) stats->bytes_in_use ? max : (uint64_t) stats->bytes_in_use;
+}
+
+bool stats_allocator_read_thread(struct allocator* a, uint32_t thread_slot, struct allocator_stats* stats) {
+    struct stats_allocator* self = container_of(a, struct stats_allocator, vfs);
+    if (thread_slot > STATS_ALLOCATOR_MAX_THREADS)
+        return false;
+    read_slot(&self->slots[thread_slot], stats);
+    return stats->allocations || stats->frees || stats->failures;
+}
+
+void stats_allocator_print(struct allocator* a, const char* name) {
+    struct allocator_stats stats;
+    stats_allocator_read(a, &stats);
+    printf("[%s] %lu allocations, %lu frees, %lu failures, %ld bytes in use, %lu bytes max\n",
+           name, stats.allocations, stats.frees, stats.failures, stats.bytes_in_use, stats.max_bytes_in_use);
+    // the threads that hold memory, blocks free'd by another thread show up as negative usage there
+    for (uint32_t i = 0; i <= STATS_ALLOCATOR_MAX_THREADS; i++) {
+        if (stats_allocator_read_thread(a, i, &stats) && stats.bytes_in_use)
+            printf("[%s] thread slot %u%s: %ld bytes in use, %lu failures\n", name, i,
+                   i == STATS_SLOT_OVERFLOW ? " (overflow)" : "", stats.bytes_in_use, stats.failures);
+    }
+}
+
+void stats_allocator_free(struct allocator* a) {
+    struct stats_allocator* self = container_of(a, struct stats_allocator, vfs);
+    free(self);
+}
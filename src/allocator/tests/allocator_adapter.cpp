@@ -0,0 +1,143 @@
+#include "allocator/allocator.h"
+#include "allocator/allocator.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <cassert>
+
+// Same approach as the spinlock allocator tests, to be replaced by real test framework
+
+struct flow_key {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t proto;
+
+    bool operator==(const flow_key& other) const {
+        return src_ip == other.src_ip && dst_ip == other.dst_ip && src_port == other.src_port
+               && dst_port == other.dst_port && proto == other.proto;
+    }
+};
+
+struct flow_hash {
+    size_t operator()(const flow_key& k) const {
+        return (((uint64_t) k.src_ip << 32) | k.dst_ip) * 0x9e3779b97f4a7c15ull
+               ^ (((uint64_t) k.src_port << 24) | ((uint64_t) k.dst_port << 8) | k.proto);
+    }
+};
+
+struct flow {
+    uint64_t pkts;
+    uint64_t bytes;
+};
+
+using flow_table = std::unordered_map<flow_key, flow, flow_hash, std::equal_to<flow_key>,
+        ixy::allocator_adapter<std::pair<const flow_key, flow>>>;
+
+static flow_key key_of(uint32_t i) {
+    return {0x0a000000 | i, 0x0a010000 | (i * 7), (uint16_t) (1024 + i), 80, 6};
+}
+
+// everything allocated through the adapter is returned
+void vector_test() {
+    auto a = stats_allocator_new(&mallocator_t);
+    {
+        std::vector<uint64_t, ixy::allocator_adapter<uint64_t>> v(a);
+        for (uint64_t i = 0; i < 10000; ++i)
+            v.push_back(i);
+        for (uint64_t i = 0; i < 10000; ++i)
+            assert(v[i] == i);
+        assert(v.get_allocator().underlying() == a);
+    }
+    allocator_stats stats;
+    stats_allocator_read(a, &stats);
+    assert(stats.allocations > 1 && stats.allocations == stats.frees && stats.bytes_in_use == 0);
+    stats_allocator_free(a);
+}
+
+// fixed size stack entries for the nodes, the bucket array is too large and falls back to malloc
+// the stack allocator only accepts blocks of its entry size back, the adapter has to remember it
+void flow_table_test() {
+    const int num_flows = 1000;
+    auto stack = spinlock_stack_allocator_new(num_flows, 128, &mallocator_t);
+    auto fallback = fallback_allocator_new(stack, &mallocator_t);
+    {
+        flow_table flows(16, flow_hash(), std::equal_to<flow_key>(), fallback);
+        for (int i = 0; i < num_flows; ++i)
+            flows[key_of(i)] = {1, 64};
+        for (int i = 0; i < num_flows; ++i) {
+            auto& f = flows.at(key_of(i));
+            f.pkts++;
+            f.bytes += 1500;
+        }
+        assert(flows.size() == num_flows);
+        assert(flows.at(key_of(42)).pkts == 2 && flows.at(key_of(42)).bytes == 1564);
+        // all nodes live in the stack
+        auto node = stack->allocate(stack, 128);
+        assert(!node.ptr);
+        (void) node;
+        for (int i = 0; i < num_flows; i += 2)
+            flows.erase(key_of(i));
+        assert(flows.size() == num_flows / 2 && !flows.count(key_of(0)) && flows.count(key_of(1)));
+    }
+    // the table returned every node
+    std::vector<mem_blk> blks;
+    for (int i = 0; i < num_flows; ++i) {
+        blks.push_back(stack->allocate(stack, 128));
+        assert(blks.back().ptr);
+    }
+    for (auto& blk : blks)
+        stack->deallocate(stack, &blk);
+    fallback_allocator_free(fallback);
+    spinlock_stack_allocator_free(stack);
+}
+
+// the memory moves together with its allocator
+void propagation_test() {
+    auto arena1 = arena_allocator_new(1 << 20, &mallocator_t);
+    auto arena2 = arena_allocator_new(1 << 20, &mallocator_t);
+    {
+        flow_table t1(16, flow_hash(), std::equal_to<flow_key>(), arena1);
+        flow_table t2(16, flow_hash(), std::equal_to<flow_key>(), arena2);
+        t1[key_of(1)] = {1, 1};
+        t2[key_of(2)] = {2, 2};
+        assert(t1.get_allocator() != t2.get_allocator());
+        std::swap(t1, t2);
+        assert(t1.get_allocator().underlying() == arena2 && t1.count(key_of(2)));
+        assert(t2.get_allocator().underlying() == arena1 && t2.count(key_of(1)));
+        t1 = std::move(t2);
+        assert(t1.get_allocator().underlying() == arena1 && t1.count(key_of(1)));
+        flow_table t3(t1.get_allocator());
+        t3 = t1;
+        assert(t3.get_allocator() == t1.get_allocator() && t3.at(key_of(1)).pkts == 1);
+        // rebound copies share the allocator
+        ixy::allocator_adapter<int> rebound(t3.get_allocator());
+        assert(rebound == t3.get_allocator());
+    }
+    arena_allocator_free(arena1);
+    arena_allocator_free(arena2);
+}
+
+void out_of_memory_test() {
+    auto stack = stack_allocator_new(1, 64, &mallocator_t);
+    std::vector<uint8_t, ixy::allocator_adapter<uint8_t>> v(stack);
+    v.reserve(32);
+    bool thrown = false;
+    try {
+        v.reserve(4096);
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    assert(thrown && v.capacity() == 32);
+    (void) thrown;
+    v.shrink_to_fit();
+    stack_allocator_free(stack);
+}
+
+int main() {
+    vector_test();
+    flow_table_test();
+    propagation_test();
+    out_of_memory_test();
+}
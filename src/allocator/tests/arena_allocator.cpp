@@ -0,0 +1,75 @@
+#include "allocator/allocator.h"
+
+#include <cstdint>
+#include <cassert>
+
+// Same approach as the spinlock allocator tests, to be replaced by real test framework
+
+void bump_test() {
+    auto a = arena_allocator_new(256, &mallocator_t);
+    auto b1 = a->allocate(a, 10);
+    auto b2 = a->allocate(a, 33);
+    assert(b1.ptr && b1.size == 10 && b2.ptr && b2.size == 33);
+    // consecutive and aligned
+    assert((uint8_t*) b2.ptr == (uint8_t*) b1.ptr + 16);
+    assert((uintptr_t) b2.ptr % a->alignment == 0);
+    assert(a->owns(a, &b1) && a->owns(a, &b2));
+    // 16 + 48 bytes used, the rest fits exactly
+    auto b3 = a->allocate(a, 192);
+    assert(b3.ptr);
+    auto full = a->allocate(a, 1);
+    assert(!full.ptr);
+    (void) b1;
+    (void) b2;
+    (void) b3;
+    (void) full;
+    arena_allocator_free(a);
+}
+
+// only the last block is given back, older ones stay allocated until the reset
+void deallocate_test() {
+    auto a = arena_allocator_new(256, &mallocator_t);
+    auto b1 = a->allocate(a, 64);
+    auto b2 = a->allocate(a, 64);
+    void* p2 = b2.ptr;
+    a->deallocate(a, &b2);
+    auto b3 = a->allocate(a, 64);
+    assert(b3.ptr == p2);
+    void* p1 = b1.ptr;
+    a->deallocate(a, &b1);
+    auto b4 = a->allocate(a, 64);
+    assert(b4.ptr != p1);
+    arena_allocator_reset(a);
+    auto b5 = a->allocate(a, 256);
+    assert(b5.ptr == p1);
+    (void) p1;
+    (void) p2;
+    (void) b3;
+    (void) b4;
+    (void) b5;
+    arena_allocator_free(a);
+}
+
+// an arena on top of a stack allocator entry, e.g., one scratch buffer per burst
+void parent_test() {
+    auto stack = stack_allocator_new(2, 1024, &mallocator_t);
+    auto a = arena_allocator_new(1024, stack);
+    assert(a);
+    auto blk = a->allocate(a, 1000);
+    assert(blk.ptr && stack->owns(stack, &blk));
+    (void) blk;
+    arena_allocator_free(a);
+    // the entry went back to the stack
+    auto e1 = stack->allocate(stack, 1024);
+    auto e2 = stack->allocate(stack, 1024);
+    assert(e1.ptr && e2.ptr);
+    stack->deallocate(stack, &e1);
+    stack->deallocate(stack, &e2);
+    stack_allocator_free(stack);
+}
+
+int main() {
+    bump_test();
+    deallocate_test();
+    parent_test();
+}
@@ -0,0 +1,147 @@
+#include "allocator/allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+// Same approach as the spinlock allocator tests, to be replaced by real test framework
+
+void create_delete_test() {
+    auto a = lockfree_stack_allocator_new(12, 64, &mallocator_t);
+    lockfree_stack_allocator_free(a);
+}
+
+void simple_alloc_test() {
+    auto a = lockfree_stack_allocator_new(12, 64, &mallocator_t);
+    auto blk = a->allocate(a, 65);
+    assert(!blk.ptr);
+    blk = a->allocate(a, 64);
+    assert(blk.ptr && blk.size >= 64);
+    assert(a->owns(a, &blk));
+    a->deallocate(a, &blk);
+    lockfree_stack_allocator_free(a);
+}
+
+// LIFO: the entry free'd last is handed out first, all entries are distinct and the stack runs empty after num_entries
+void exhaust_test() {
+    const uint32_t num_entries = 12;
+    auto a = lockfree_stack_allocator_new(num_entries, 64, &mallocator_t);
+    std::vector<mem_blk> blks;
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        auto blk = a->allocate(a, 64);
+        assert(blk.ptr);
+        assert(std::none_of(blks.begin(), blks.end(), [&](const mem_blk& other) { return other.ptr == blk.ptr; }));
+        blks.push_back(blk);
+    }
+    auto empty = a->allocate(a, 64);
+    assert(!empty.ptr);
+    auto last = blks.back();
+    a->deallocate(a, &blks.back());
+    auto blk = a->allocate(a, 64);
+    assert(blk.ptr == last.ptr);
+    (void) empty;
+    (void) last;
+    blks.back() = blk;
+    for (auto& b : blks)
+        a->deallocate(a, &b);
+    lockfree_stack_allocator_free(a);
+}
+
+// every thread stamps the blocks it holds, a block handed out twice (e.g., after an ABA on the head) breaks the stamp
+void mt_contended_test() {
+    const uint32_t num_threads = 8;
+    const uint32_t num_entries = 16;
+    const int iterations = 50000;
+    auto a = lockfree_stack_allocator_new(num_entries, 64, &mallocator_t);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < iterations; ++i) {
+                mem_blk blks[3];
+                uint32_t num = 0;
+                for (; num < 3; ++num) {
+                    blks[num] = a->allocate(a, 64);
+                    if (!blks[num].ptr)
+                        break;
+                    memset(blks[num].ptr, (int) t, 64);
+                }
+                std::this_thread::yield();
+                for (uint32_t j = 0; j < num; ++j) {
+                    for (int k = 0; k < 64; ++k)
+                        if (((uint8_t*) blks[j].ptr)[k] != t)
+                            failed = true;
+                    a->deallocate(a, &blks[j]);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    assert(!failed);
+    // nothing was lost or duplicated: exactly num_entries distinct blocks are left
+    std::vector<mem_blk> blks;
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        auto blk = a->allocate(a, 64);
+        assert(blk.ptr);
+        assert(std::none_of(blks.begin(), blks.end(), [&](const mem_blk& other) { return other.ptr == blk.ptr; }));
+        blks.push_back(blk);
+    }
+    auto empty = a->allocate(a, 64);
+    assert(!empty.ptr);
+    (void) empty;
+    for (auto& b : blks)
+        a->deallocate(a, &b);
+    lockfree_stack_allocator_free(a);
+}
+
+// blocks are allocated on one thread and free'd on another
+void mt_producer_consumer_test() {
+    const uint32_t num_entries = 8;
+    const int iterations = 100000;
+    auto a = lockfree_stack_allocator_new(num_entries, 64, &mallocator_t);
+    std::atomic<void*> slot(nullptr);
+    auto producer = std::thread([&]() {
+        for (int i = 0; i < iterations;) {
+            if (slot.load()) {
+                std::this_thread::yield();
+                continue;
+            }
+            auto blk = a->allocate(a, 64);
+            assert(blk.ptr);
+            slot = blk.ptr;
+            ++i;
+        }
+    });
+    auto consumer = std::thread([&]() {
+        for (int i = 0; i < iterations;) {
+            void* ptr = slot.exchange(nullptr);
+            if (!ptr) {
+                std::this_thread::yield();
+                continue;
+            }
+            mem_blk blk = {ptr, 64};
+            a->deallocate(a, &blk);
+            ++i;
+        }
+    });
+    producer.join();
+    consumer.join();
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        auto blk = a->allocate(a, 64);
+        assert(blk.ptr);
+        (void) blk;
+    }
+    lockfree_stack_allocator_free(a);
+}
+
+int main() {
+    create_delete_test();
+    simple_alloc_test();
+    exhaust_test();
+    mt_contended_test();
+    mt_producer_consumer_test();
+}
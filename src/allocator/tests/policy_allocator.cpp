@@ -0,0 +1,100 @@
+#include "allocator/allocator.h"
+#include "allocator/policy_allocator.hpp"
+
+#include <vector>
+#include <cassert>
+
+// Same approach as the spinlock allocator tests, to be replaced by real test framework
+
+using namespace ixy::policy;
+
+void stack_test() {
+    stack<64, 4> a;
+    std::vector<mem_blk> blks;
+    for (int i = 0; i < 4; ++i) {
+        blks.push_back(a.allocate(64));
+        assert(blks.back().ptr && blks.back().size == 64 && a.owns(&blks.back()));
+    }
+    assert(!a.allocate(1).ptr);
+    assert(!a.allocate(65).ptr);
+    a.deallocate(&blks[2]);
+    // LIFO
+    auto blk = a.allocate(32);
+    assert(blk.size == 64 && a.owns(&blk));
+    a.deallocate(&blk);
+    for (int i : {0, 1, 3})
+        a.deallocate(&blks[i]);
+}
+
+void null_test() {
+    null_allocator a;
+    auto blk = a.allocate(64);
+    assert(!blk.ptr && !a.owns(&blk));
+    a.deallocate(&blk);
+}
+
+// the stack takes what it can, the rest goes to the secondary and is returned there
+void fallback_test() {
+    fallback<stack<128, 2>, mallocator> a;
+    auto b1 = a.allocate(100);
+    auto b2 = a.allocate(100);
+    auto b3 = a.allocate(100);
+    assert(a.primary.owns(&b1) && a.primary.owns(&b2) && !a.primary.owns(&b3));
+    assert(b3.ptr && b3.size == 100 && a.owns(&b3));
+    a.deallocate(&b3);
+    a.deallocate(&b1);
+    a.deallocate(&b2);
+    // a fallback to the null allocator only limits the stack
+    fallback<stack<128, 1>, null_allocator> limited;
+    auto b4 = limited.allocate(1);
+    assert(b4.ptr && !limited.allocate(1).ptr);
+    limited.deallocate(&b4);
+}
+
+// nested segregators form size classes, blocks go back to their class by size
+void segregator_test() {
+    segregator<64, stack<64, 2>, segregator<256, stack<256, 2>, mallocator>> a;
+    auto small = a.allocate(1);
+    auto medium = a.allocate(65);
+    auto large = a.allocate(1000);
+    assert(small.size == 64 && a.small.owns(&small));
+    assert(medium.size == 256 && a.large.small.owns(&medium));
+    assert(large.size == 1000 && !a.large.small.owns(&large) && a.owns(&large));
+    a.deallocate(&small);
+    a.deallocate(&medium);
+    a.deallocate(&large);
+    // both entries are back in the 64 byte class
+    auto s1 = a.allocate(64);
+    auto s2 = a.allocate(64);
+    assert(a.small.owns(&s1) && a.small.owns(&s2));
+    a.deallocate(&s1);
+    a.deallocate(&s2);
+}
+
+// C allocators as parents
+void c_parent_test() {
+    auto arena = arena_allocator_new(1024, &mallocator_t);
+    {
+        stack<64, 8, vtable_allocator> a{vtable_allocator(arena)};
+        auto blk = a.allocate(64);
+        assert(blk.ptr && arena->owns(arena, &blk));
+        a.deallocate(&blk);
+        // the stack took half of the arena
+        auto rest = arena->allocate(arena, 512);
+        assert(rest.ptr && !arena->allocate(arena, 1).ptr);
+        arena->deallocate(arena, &rest);
+    }
+    arena_allocator_free(arena);
+    fallback<stack<64, 1, c_allocator<&mallocator_t>>, c_allocator<&null_allocator_t>> a;
+    auto blk = a.allocate(10);
+    assert(blk.ptr && !a.allocate(10).ptr);
+    a.deallocate(&blk);
+}
+
+int main() {
+    stack_test();
+    null_test();
+    fallback_test();
+    segregator_test();
+    c_parent_test();
+}
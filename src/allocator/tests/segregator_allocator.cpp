@@ -0,0 +1,87 @@
+#include "allocator/allocator.h"
+
+#include <cassert>
+
+// Same approach as the spinlock allocator tests, to be replaced by real test framework
+
+// the classes used for packet buffers and per-flow state: 128 byte metadata, 2 KB and 9 KB (jumbo) buffers
+const size_t class_sizes[] = {128, 2048, 9216};
+
+void routing_test() {
+    struct allocator* children[] = {
+        stack_allocator_new(4, 128, &mallocator_t),
+        stack_allocator_new(4, 2048, &mallocator_t),
+        stack_allocator_new(4, 9216, &mallocator_t)
+    };
+    auto a = segregator_allocator_new(class_sizes, children, 3, nullptr);
+    // every size ends up in the smallest class that fits, including the class boundaries
+    const size_t sizes[] = {0, 1, 64, 128, 129, 2000, 2048, 2049, 9216};
+    const size_t expected[] = {128, 128, 128, 128, 2048, 2048, 2048, 9216, 9216};
+    for (int i = 0; i < 9; ++i) {
+        auto blk = a->allocate(a, sizes[i]);
+        assert(blk.ptr && blk.size == expected[i]);
+        assert(a->owns(a, &blk));
+        a->deallocate(a, &blk);
+    }
+    (void) expected;
+    // no large allocator: requests above the largest class fail
+    auto blk = a->allocate(a, 9217);
+    assert(!blk.ptr);
+    (void) blk;
+    segregator_allocator_free(a);
+    for (auto child : children)
+        stack_allocator_free(child);
+}
+
+void exhaust_test() {
+    struct allocator* children[] = {
+        stack_allocator_new(2, 128, &mallocator_t),
+        stack_allocator_new(2, 2048, &mallocator_t),
+        stack_allocator_new(2, 9216, &mallocator_t)
+    };
+    auto a = segregator_allocator_new(class_sizes, children, 3, &mallocator_t);
+    mem_blk small[2];
+    for (auto& blk : small) {
+        blk = a->allocate(a, 100);
+        assert(blk.ptr);
+    }
+    // classes don't borrow from each other
+    assert(!a->allocate(a, 100).ptr);
+    auto medium = a->allocate(a, 1500);
+    assert(medium.ptr && children[1]->owns(children[1], &medium));
+    // everything larger goes to the large allocator
+    auto large = a->allocate(a, 64 * 1024);
+    assert(large.ptr && large.size == 64 * 1024);
+    a->deallocate(a, &large);
+    a->deallocate(a, &medium);
+    for (auto& blk : small)
+        a->deallocate(a, &blk);
+    segregator_allocator_free(a);
+    for (auto child : children)
+        stack_allocator_free(child);
+}
+
+// sizes without a large power of two factor still work, the lookup table just gets finer
+void odd_sizes_test() {
+    const size_t odd_sizes[] = {100, 1500};
+    struct allocator* children[] = {
+        stack_allocator_new(2, 100, &mallocator_t),
+        stack_allocator_new(2, 1500, &mallocator_t)
+    };
+    auto a = segregator_allocator_new(odd_sizes, children, 2, nullptr);
+    auto blk = a->allocate(a, 100);
+    assert(blk.ptr && blk.size == 100);
+    a->deallocate(a, &blk);
+    blk = a->allocate(a, 101);
+    assert(blk.ptr && blk.size == 1500);
+    a->deallocate(a, &blk);
+    segregator_allocator_free(a);
+    for (auto child : children)
+        stack_allocator_free(child);
+}
+
+int main() {
+    routing_test();
+    exhaust_test();
+    odd_sizes_test();
+}
@@ -1,7 +1,11 @@
 #include "allocator/allocator.h"
+#include "allocator/rte_spinlock.h"
 
 #include <thread>
 #include <vector>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <cassert>
 
 // This is in C++ because dealing with threads through pthread is zero fun
@@ -64,10 +68,115 @@ void mt_concurrent_alloc_free() {
     spinlock_stack_allocator_free(a);
 }
 
+// the fair locks protect the stack as well as the spinlock
+// fair locks hand the lock to a waiter that may not be running if there are more threads than cores, so the
+// iterations are kept low for small machines
+void mt_lock_types_test() {
+    const int iterations = std::thread::hardware_concurrency() >= 4 ? 20000 : 500;
+    for (auto lock_type : {STACK_LOCK_SPINLOCK, STACK_LOCK_TICKETLOCK, STACK_LOCK_MCSLOCK, STACK_LOCK_SPINLOCK_TM}) {
+        const int num_entries = 12;
+        auto a = spinlock_stack_allocator_new_lock(num_entries, 64, &mallocator_t, lock_type);
+        auto f = [&]() {
+            for (int i = 0; i < iterations; ++i) {
+                auto b1 = a->allocate(a, 64);
+                auto b2 = a->allocate(a, 64);
+                assert(b1.ptr && b2.ptr && b1.ptr != b2.ptr);
+                a->deallocate(a, &b1);
+                a->deallocate(a, &b2);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+            threads.emplace_back(f);
+        for (auto& t : threads)
+            t.join();
+        // all entries are back
+        std::vector<mem_blk> blks;
+        for (int i = 0; i < num_entries; ++i) {
+            blks.push_back(a->allocate(a, 64));
+            assert(blks.back().ptr);
+        }
+        assert(!a->allocate(a, 64).ptr);
+        for (auto& blk : blks)
+            a->deallocate(a, &blk);
+        spinlock_stack_allocator_free(a);
+    }
+}
+
+// without RTM the _tm variants must take the lock for real
+void tm_fallback_test() {
+    rte_spinlock_t sl;
+    rte_spinlock_init(&sl);
+    rte_spinlock_lock_tm(&sl);
+    // elided: running in a transaction with the lock still free
+    assert(rte_rtm_supported() ? rte_xtest() && !rte_spinlock_is_locked(&sl) : rte_spinlock_is_locked(&sl));
+    rte_spinlock_unlock_tm(&sl);
+    assert(!rte_spinlock_is_locked(&sl));
+    // a taken lock can not be elided, trylock gives up at once instead of waiting for it
+    rte_spinlock_lock(&sl);
+    int taken = rte_spinlock_trylock_tm(&sl);
+    assert(!taken);
+    rte_spinlock_unlock(&sl);
+    rte_spinlock_recursive_t slr;
+    rte_spinlock_recursive_init(&slr);
+    rte_spinlock_lock(&slr.sl);
+    taken = rte_spinlock_recursive_trylock_tm(&slr);
+    assert(!taken);
+    rte_spinlock_unlock(&slr.sl);
+    // a recursive lock held by this thread is taken again, not waited for
+    rte_spinlock_recursive_lock(&slr);
+    rte_spinlock_recursive_lock_tm(&slr);
+    taken = rte_spinlock_recursive_trylock_tm(&slr);
+    assert(taken && slr.count == 3);
+    (void) taken;
+    rte_spinlock_recursive_unlock_tm(&slr);
+    rte_spinlock_recursive_unlock_tm(&slr);
+    rte_spinlock_recursive_unlock(&slr);
+    assert(!rte_spinlock_is_locked(&slr.sl) && slr.user == -1);
+}
+
+// runs f in a child process, returns true if it was stopped by error()
+template<typename F>
+static bool aborts(F f) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        f();
+        _exit(0);
+    }
+    int status = 0;
+    pid_t waited = waitpid(pid, &status, 0);
+    assert(pid > 0 && waited == pid);
+    (void) waited;
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+// blocks outside of the stack must be rejected, including the one right past the last entry
+void foreign_block_test() {
+    auto a = spinlock_stack_allocator_new(12, 64, &mallocator_t);
+    std::vector<mem_blk> blks;
+    for (int i = 0; i < 12; i++)
+        blks.push_back(a->allocate(a, 64));
+    auto base = (uint8_t*) blks[0].ptr;
+    for (auto& blk : blks)
+        base = (uint8_t*) blk.ptr < base ? (uint8_t*) blk.ptr : base;
+    mem_blk last = { base + 11 * 64, 64 };
+    mem_blk past_end = { base + 12 * 64, 64 };
+    assert(!aborts([&]() { a->deallocate(a, &last); }));
+    assert(aborts([&]() { a->deallocate(a, &past_end); }));
+    (void) last;
+    (void) past_end;
+    for (auto& blk : blks)
+        a->deallocate(a, &blk);
+    spinlock_stack_allocator_free(a);
+}
+
 int main() {
     create_delete_test();
     mt_create_delete_test();
     simple_alloc_test();
     mt_test();
     mt_concurrent_alloc_free();
+    mt_lock_types_test();
+    tm_fallback_test();
+    foreign_block_test();
 }
\ No newline at end of file
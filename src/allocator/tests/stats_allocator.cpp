@@ -0,0 +1,73 @@
+#include "allocator/allocator.h"
+
+#include <thread>
+#include <vector>
+#include <cassert>
+
+// Same approach as the spinlock allocator tests, to be replaced by real test framework
+
+void counters_test() {
+    auto stack = stack_allocator_new(2, 64, &mallocator_t);
+    auto a = stats_allocator_new(stack);
+    auto b1 = a->allocate(a, 64);
+    auto b2 = a->allocate(a, 64);
+    auto b3 = a->allocate(a, 64);
+    assert(b1.ptr && b2.ptr && !b3.ptr);
+    (void) b3;
+    assert(a->owns(a, &b1));
+    a->deallocate(a, &b1);
+    allocator_stats stats;
+    stats_allocator_read(a, &stats);
+    assert(stats.allocations == 2 && stats.frees == 1 && stats.failures == 1);
+    assert(stats.bytes_allocated == 128 && stats.bytes_freed == 64 && stats.bytes_in_use == 64);
+    assert(stats.max_bytes_in_use == 64);
+    // per thread: this thread held both blocks at once
+    bool found = stats_allocator_read_thread(a, stats_allocator_thread_slot(), &stats);
+    assert(found && stats.max_bytes_in_use == 128);
+    (void) found;
+    a->deallocate(a, &b2);
+    stats_allocator_read(a, &stats);
+    assert(stats.bytes_in_use == 0 && stats.max_bytes_in_use == 64);
+    stats_allocator_free(a);
+    stack_allocator_free(stack);
+}
+
+// every thread counts separately, the sum is exact after the threads are done
+void mt_test() {
+    const int num_threads = 4;
+    const int iterations = 10000;
+    auto a = stats_allocator_new(&mallocator_t);
+    std::vector<std::thread> threads;
+    std::vector<uint32_t> slots(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            slots[t] = stats_allocator_thread_slot();
+            for (int i = 0; i < iterations; ++i) {
+                auto blk = a->allocate(a, 100);
+                a->deallocate(a, &blk);
+            }
+            // keep one block, the thread holding it shows up in its slot
+            if (t == 0)
+                a->allocate(a, 100);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    allocator_stats stats;
+    stats_allocator_read(a, &stats);
+    assert(stats.allocations == num_threads * iterations + 1);
+    assert(stats.frees == num_threads * iterations);
+    assert(stats.bytes_in_use == 100);
+    for (int t = 0; t < num_threads; ++t) {
+        assert(slots[t] != stats_allocator_thread_slot());
+        bool found = stats_allocator_read_thread(a, slots[t], &stats);
+        assert(found && stats.bytes_in_use == (t == 0 ? 100 : 0));
+        (void) found;
+    }
+    stats_allocator_free(a);
+}
+
+int main() {
+    counters_test();
+    mt_test();
+}
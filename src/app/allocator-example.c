@@ -1,4 +1,5 @@
 #include "allocator/allocator.h"
+#include "memory.h"
 
 #include <stdio.h>
 #include <log.h>
@@ -55,4 +56,29 @@ int main() {
     blk = a->allocate(a, 8 * 1024 * 1024);
     printf("%p, %zu\n", blk.ptr, blk.size);
     a->deallocate(a, &blk);
+
+    // packet pools take their memory from an allocator and can be composed like allocators themselves
+    struct mempool_params params;
+    mempool_params_init(&params, 16, 2048);
+    params.parent = &dma_allocator_t;
+    struct mempool* primary = memory_allocate_mempool_ext(&params);
+    params.num_entries = 4;
+    struct mempool* secondary = memory_allocate_mempool_ext(&params);
+    a = fallback_allocator_new(mempool_allocator(primary), mempool_allocator(secondary));
+    struct pkt_buf* bufs[20];
+    for (int i = 0; i < 20; ++i) {
+        bufs[i] = pkt_buf_alloc_from(a);
+        if (!bufs[i])
+            error("pool allocation failed at i %i", i);
+    }
+    if (bufs[0]->mempool != primary || bufs[19]->mempool != secondary)
+        error("buffers must come from the primary pool first");
+    if (pkt_buf_alloc_from(a))
+        error("both pools should be empty");
+    blk = (struct mem_blk) {bufs[19], secondary->buf_size};
+    if (primary->vfs.owns(mempool_allocator(primary), &blk) || !a->owns(a, &blk))
+        error("buffer must be owned by the secondary pool");
+    a->deallocate(a, &blk);
+    pkt_buf_free_batch(bufs, 19);
+    fallback_allocator_free(a);
 }
@@ -5,13 +5,15 @@
 #include "log.h"
 #include "memory.h"
 #include "driver/ixgbe.h"
+#include "exception_path.h"
 #include "libseccomp_init.h"
 
 
 int main(int argc, char* argv[]) {
-	if (argc != 3) {
+	if (argc != 3 && argc != 4) {
 		printf("%s forwards packets between two ports.\n", argv[0]);
-		printf("Usage: %s <pci bus id2> <pci bus id1>\n", argv[0]);
+		printf("Usage: %s <pci bus id2> <pci bus id1> [tap interface]\n", argv[0]);
+		printf("Slow-path packets (ARP, ICMP, ...) from the first port are passed to the tap interface if given.\n");
 		return 1;
 	}
 
@@ -24,6 +26,13 @@ int main(int argc, char* argv[]) {
 		// this effectively turns this into an echo server
 		dev2 = dev1;
 	}
+	struct exception_path* ep = NULL;
+	struct mempool* ep_mempool = NULL;
+	if (argc == 4) {
+		// must happen before setup_seccomp(), the exception thread installs its own filter
+		ep = exception_path_start(argv[3]);
+		ep_mempool = memory_allocate_mempool(512, 0);
+	}
 	setup_seccomp();
 
 	uint64_t last_stats_printed = monotonic_time();
@@ -38,10 +47,18 @@ int main(int argc, char* argv[]) {
 
 	while (true) {
 		struct pkt_buf* buf = ixgbe_rx_packet(dev1, 0);
-		if (buf) {
+		// packets diverted to the kernel are already free'd
+		if (buf && (!ep || exception_path_divert(ep, &buf, 1))) {
 			// transmit function takes care of freeing the packet
 			ixgbe_tx_packet(dev2, 0, buf);
 		}
+		if (ep) {
+			// packets from the kernel go out on the port the slow-path packets came from
+			struct pkt_buf* kernel_buf;
+			if (exception_path_fetch(ep, ep_mempool, &kernel_buf, 1) && !ixgbe_tx_packet(dev1, 0, kernel_buf)) {
+				pkt_buf_free(kernel_buf);
+			}
+		}
 
 		// don't poll the time unnecessarily
 		if ((counter++ & 0xFFF) == 0) {
@@ -10,6 +10,9 @@
 // excluding CRC (offloaded by default)
 static const int PKT_SIZE = 60;
 
+// number of packets allocated from the mempool at once
+static const int BATCH_SIZE = 64;
+
 static struct mempool* init_mempool() {
 	const int NUM_BUFS = 2048;
 	struct mempool* mempool = memory_allocate_mempool(NUM_BUFS, 0);
@@ -17,19 +20,20 @@ static struct mempool* init_mempool() {
 	// pre-fill all our packet buffers with some templates that can be modified later
 	// we have to do it like this because sending is async in the hardware; we cannot re-use a buffer immediately
 	struct pkt_buf* bufs[NUM_BUFS];
+	if (pkt_buf_alloc_batch(mempool, bufs, NUM_BUFS) != (uint32_t) NUM_BUFS) {
+		error("failed to allocate packet templates");
+	}
 	for (int buf_id = 0; buf_id < NUM_BUFS; buf_id++) {
-		struct pkt_buf* buf = pkt_buf_alloc(mempool);
+		struct pkt_buf* buf = bufs[buf_id];
 		buf->size = PKT_SIZE;
 		// TODO: initialize packet with something else here
+		uint8_t* data = pkt_buf_data(buf);
 		for (int i = 0; i < PKT_SIZE; i++) {
-			buf->data[i] = 0xFF;
+			data[i] = 0xFF;
 		}
-		bufs[buf_id] = buf;
 	}
 	// return them all to the mempool, all future allocations will return bufs with the data set above
-	for (int buf_id = 0; buf_id < NUM_BUFS; buf_id++) {
-		pkt_buf_free(bufs[buf_id]);
-	}
+	pkt_buf_free_batch(bufs, NUM_BUFS);
 
 	return mempool;
 }
@@ -50,20 +54,23 @@ int main(int argc, char* argv[]) {
 	stats_init(&stats_old, dev);
 
 	uint64_t counter = 0;
+	struct pkt_buf* bufs[BATCH_SIZE];
 	// tx loop
 	while (true) {
-		// we cannot immediately recycle a packet, we need to allocate a new one
-		// the old packet might still be used by the NIC
-		struct pkt_buf* buf = pkt_buf_alloc(mempool);
-		// the packet could be modified here to generate multiple flows
-		// transmit is non-blocking, we have to retry until there is space in the queue
-		while (!ixgbe_tx_packet(dev, 0, buf)) {
-			// this is the busy-wait part of a typical ixy or DPDK app, you could do a short sleep here
-			// to prevent 100% cpu load at the cost of reliability
-		};
+		// we cannot immediately recycle a packet, we need to allocate new ones
+		// the old packets might still be used by the NIC
+		uint32_t num_bufs = pkt_buf_alloc_batch(mempool, bufs, BATCH_SIZE);
+		for (uint32_t i = 0; i < num_bufs; i++) {
+			// the packet could be modified here to generate multiple flows
+			// transmit is non-blocking, we have to retry until there is space in the queue
+			while (!ixgbe_tx_packet(dev, 0, bufs[i])) {
+				// this is the busy-wait part of a typical ixy or DPDK app, you could do a short sleep here
+				// to prevent 100% cpu load at the cost of reliability
+			};
+		}
 
-		// don't check time for every packet, this yields +10% performance :)
-		if ((counter++ & 0xFFF) == 0) {
+		// don't check time for every batch, this yields +10% performance :)
+		if ((counter++ & 0x3F) == 0) {
 			uint64_t time = monotonic_time();
 			if (time - last_stats_printed > 1000 * 1000 * 1000) {
 				// every second
@@ -0,0 +1,442 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "log.h"
+#include "allocator/allocator.h"
+
+// throughput and latency percentiles of the allocators in src/allocator for three access patterns:
+//  local:             every thread frees the blocks it allocated, in bursts (1 thread is the single-threaded case)
+//  producer-consumer: threads form pairs, one allocates and passes the blocks to the other one which frees them
+//  all-to-all:        blocks are dropped into random slots shared by all threads, whoever replaces a block frees it
+// results are written as csv (default) or json, one record per allocator, pattern and thread count, e.g.:
+// ./allocator-bench --json 16 1000000 > results.json
+
+#define BLOCK_SIZE 2048
+#define BURST_SIZE 8
+#define QUEUE_SIZE 256
+#define SLOTS_PER_THREAD 64
+// every 16th operation is timed
+#define SAMPLE_MASK 15
+#define MAX_SAMPLES (1 << 16)
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_OPS_PER_THREAD 200000
+
+enum bench_pattern {
+	PATTERN_LOCAL,
+	PATTERN_PRODUCER_CONSUMER,
+	PATTERN_ALL_TO_ALL,
+	NUM_PATTERNS
+};
+
+static const char* pattern_names[NUM_PATTERNS] = {"local", "producer-consumer", "all-to-all"};
+
+struct bench_config {
+	const char* name;
+	struct allocator* (*create)(uint32_t num_entries);
+	void (*destroy)(struct allocator* a);
+	bool thread_safe;
+};
+
+// single producer, single consumer queue of blocks
+struct bench_queue {
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+	void* blocks[QUEUE_SIZE] __attribute__((aligned(64)));
+};
+
+struct bench_run {
+	struct allocator* allocator;
+	enum bench_pattern pattern;
+	uint32_t num_threads;
+	uint32_t ops_per_thread;
+	pthread_barrier_t barrier;
+	struct bench_queue* queues;
+	void** slots;
+};
+
+struct bench_thread {
+	struct bench_run* run;
+	uint32_t id;
+	pthread_t thread;
+	uint32_t num_alloc_samples;
+	uint32_t num_free_samples;
+	uint32_t alloc_samples[MAX_SAMPLES];
+	uint32_t free_samples[MAX_SAMPLES];
+	uint64_t failures;
+	uint64_t start_time;
+	uint64_t end_time;
+};
+
+static double cycles_per_ns;
+// cost of the two rdtsc calls around a timed operation, subtracted from every sample
+static uint64_t timer_overhead;
+
+static uint64_t monotonic_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 * 1000 * 1000ULL + ts.tv_nsec;
+}
+
+static void calibrate_tsc() {
+	uint64_t start_ns = monotonic_time();
+	uint64_t start_cycles = __rdtsc();
+	struct timespec sleep = {0, 50 * 1000 * 1000};
+	nanosleep(&sleep, NULL);
+	cycles_per_ns = (double) (__rdtsc() - start_cycles) / (double) (monotonic_time() - start_ns);
+	timer_overhead = UINT64_MAX;
+	for (int i = 0; i < 1000; i++) {
+		uint64_t start = __rdtsc();
+		uint64_t cycles = __rdtsc() - start;
+		timer_overhead = cycles < timer_overhead ? cycles : timer_overhead;
+	}
+}
+
+static inline uint32_t sample_cycles(uint64_t start) {
+	uint64_t cycles = __rdtsc() - start;
+	return (uint32_t) (cycles > timer_overhead ? cycles - timer_overhead : 0);
+}
+
+// allocator configurations, the fallback primary is small so that the fallback path is actually taken
+static struct allocator* fallback_primary;
+
+static struct allocator* create_mallocator(uint32_t num_entries) {
+	return &mallocator_t;
+}
+
+static void destroy_mallocator(struct allocator* a) {
+}
+
+static struct allocator* create_stack(uint32_t num_entries) {
+	return stack_allocator_new(num_entries, BLOCK_SIZE, &mallocator_t);
+}
+
+static struct allocator* create_spinlock_stack(uint32_t num_entries) {
+	return spinlock_stack_allocator_new(num_entries, BLOCK_SIZE, &mallocator_t);
+}
+
+static struct allocator* create_tm_stack(uint32_t num_entries) {
+	return spinlock_stack_allocator_new_lock(num_entries, BLOCK_SIZE, &mallocator_t, STACK_LOCK_SPINLOCK_TM);
+}
+
+static struct allocator* create_ticketlock_stack(uint32_t num_entries) {
+	return spinlock_stack_allocator_new_lock(num_entries, BLOCK_SIZE, &mallocator_t, STACK_LOCK_TICKETLOCK);
+}
+
+static struct allocator* create_mcslock_stack(uint32_t num_entries) {
+	return spinlock_stack_allocator_new_lock(num_entries, BLOCK_SIZE, &mallocator_t, STACK_LOCK_MCSLOCK);
+}
+
+static struct allocator* create_lockfree_stack(uint32_t num_entries) {
+	return lockfree_stack_allocator_new(num_entries, BLOCK_SIZE, &mallocator_t);
+}
+
+static struct allocator* create_fallback(uint32_t num_entries) {
+	fallback_primary = spinlock_stack_allocator_new(num_entries / 4, BLOCK_SIZE, &mallocator_t);
+	return fallback_allocator_new(fallback_primary, &mallocator_t);
+}
+
+static void destroy_fallback(struct allocator* a) {
+	fallback_allocator_free(a);
+	spinlock_stack_allocator_free(fallback_primary);
+}
+
+// shows the overhead of the counters compared to the plain lockfree_stack
+static struct allocator* stats_parent;
+
+static struct allocator* create_stats(uint32_t num_entries) {
+	stats_parent = lockfree_stack_allocator_new(num_entries, BLOCK_SIZE, &mallocator_t);
+	return stats_allocator_new(stats_parent);
+}
+
+static void destroy_stats(struct allocator* a) {
+	stats_allocator_free(a);
+	lockfree_stack_allocator_free(stats_parent);
+}
+
+static const struct bench_config configs[] = {
+	{"mallocator", create_mallocator, destroy_mallocator, true},
+	{"stack", create_stack, stack_allocator_free, false},
+	{"spinlock_stack", create_spinlock_stack, spinlock_stack_allocator_free, true},
+	{"spinlock_stack(tm)", create_tm_stack, spinlock_stack_allocator_free, true},
+	{"spinlock_stack(ticketlock)", create_ticketlock_stack, spinlock_stack_allocator_free, true},
+	{"spinlock_stack(mcslock)", create_mcslock_stack, spinlock_stack_allocator_free, true},
+	{"lockfree_stack", create_lockfree_stack, lockfree_stack_allocator_free, true},
+	{"fallback(spinlock_stack,mallocator)", create_fallback, destroy_fallback, true},
+	{"stats(lockfree_stack)", create_stats, destroy_stats, true},
+};
+
+static inline void* bench_allocate(struct bench_thread* bt, uint32_t op) {
+	struct allocator* a = bt->run->allocator;
+	struct mem_blk blk;
+	if ((op & SAMPLE_MASK) || bt->num_alloc_samples == MAX_SAMPLES) {
+		blk = a->allocate(a, BLOCK_SIZE);
+	} else {
+		uint64_t start = __rdtsc();
+		blk = a->allocate(a, BLOCK_SIZE);
+		bt->alloc_samples[bt->num_alloc_samples++] = sample_cycles(start);
+	}
+	if (!blk.ptr) {
+		bt->failures++;
+	}
+	return blk.ptr;
+}
+
+static inline void bench_free(struct bench_thread* bt, void* ptr, uint32_t op) {
+	struct allocator* a = bt->run->allocator;
+	struct mem_blk blk = {ptr, BLOCK_SIZE};
+	if ((op & SAMPLE_MASK) || bt->num_free_samples == MAX_SAMPLES) {
+		a->deallocate(a, &blk);
+	} else {
+		uint64_t start = __rdtsc();
+		a->deallocate(a, &blk);
+		bt->free_samples[bt->num_free_samples++] = sample_cycles(start);
+	}
+}
+
+static void run_local(struct bench_thread* bt) {
+	void* blocks[BURST_SIZE];
+	for (uint32_t op = 0; op < bt->run->ops_per_thread; op += BURST_SIZE) {
+		for (uint32_t i = 0; i < BURST_SIZE; i++) {
+			blocks[i] = bench_allocate(bt, op + i);
+		}
+		for (uint32_t i = 0; i < BURST_SIZE; i++) {
+			if (blocks[i]) {
+				bench_free(bt, blocks[i], op + i);
+			}
+		}
+	}
+}
+
+static void run_producer(struct bench_thread* bt, struct bench_queue* queue) {
+	for (uint32_t op = 0; op < bt->run->ops_per_thread;) {
+		if (queue->head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == QUEUE_SIZE) {
+			sched_yield();
+			continue;
+		}
+		void* ptr = bench_allocate(bt, op);
+		if (!ptr) {
+			sched_yield();
+			continue;
+		}
+		queue->blocks[queue->head % QUEUE_SIZE] = ptr;
+		__atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+		op++;
+	}
+}
+
+static void run_consumer(struct bench_thread* bt, struct bench_queue* queue) {
+	for (uint32_t op = 0; op < bt->run->ops_per_thread;) {
+		if (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == queue->tail) {
+			sched_yield();
+			continue;
+		}
+		bench_free(bt, queue->blocks[queue->tail % QUEUE_SIZE], op);
+		__atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+		op++;
+	}
+}
+
+static void run_all_to_all(struct bench_thread* bt) {
+	uint32_t num_slots = bt->run->num_threads * SLOTS_PER_THREAD;
+	uint32_t rand = bt->id * 2654435761u + 1;
+	for (uint32_t op = 0; op < bt->run->ops_per_thread; op++) {
+		void* ptr = bench_allocate(bt, op);
+		if (!ptr) {
+			continue;
+		}
+		// xorshift
+		rand ^= rand << 13;
+		rand ^= rand >> 17;
+		rand ^= rand << 5;
+		void* old = __atomic_exchange_n(&bt->run->slots[rand % num_slots], ptr, __ATOMIC_ACQ_REL);
+		if (old) {
+			bench_free(bt, old, op);
+		}
+	}
+}
+
+static void* bench_thread(void* arg) {
+	struct bench_thread* bt = (struct bench_thread*) arg;
+	pthread_barrier_wait(&bt->run->barrier);
+	bt->start_time = monotonic_time();
+	switch (bt->run->pattern) {
+		case PATTERN_LOCAL:
+			run_local(bt);
+			break;
+		case PATTERN_PRODUCER_CONSUMER:
+			if (bt->id % 2) {
+				run_consumer(bt, &bt->run->queues[bt->id / 2]);
+			} else {
+				run_producer(bt, &bt->run->queues[bt->id / 2]);
+			}
+			break;
+		case PATTERN_ALL_TO_ALL:
+			run_all_to_all(bt);
+			break;
+		default:
+			break;
+	}
+	bt->end_time = monotonic_time();
+	return NULL;
+}
+
+static int compare_samples(const void* a, const void* b) {
+	uint32_t x = *(const uint32_t*) a;
+	uint32_t y = *(const uint32_t*) b;
+	return (x > y) - (x < y);
+}
+
+struct percentiles {
+	double p50, p99, p999, max;
+};
+
+// merges the samples of all threads, the samples are in cycles, the result in nanoseconds
+static struct percentiles compute_percentiles(struct bench_thread* threads, uint32_t num_threads, bool alloc) {
+	uint32_t num = 0;
+	for (uint32_t i = 0; i < num_threads; i++) {
+		num += alloc ? threads[i].num_alloc_samples : threads[i].num_free_samples;
+	}
+	if (!num) {
+		return (struct percentiles) {0, 0, 0, 0};
+	}
+	uint32_t* samples = (uint32_t*) malloc(num * sizeof(uint32_t));
+	uint32_t pos = 0;
+	for (uint32_t i = 0; i < num_threads; i++) {
+		uint32_t n = alloc ? threads[i].num_alloc_samples : threads[i].num_free_samples;
+		memcpy(samples + pos, alloc ? threads[i].alloc_samples : threads[i].free_samples, n * sizeof(uint32_t));
+		pos += n;
+	}
+	qsort(samples, num, sizeof(uint32_t), compare_samples);
+	struct percentiles p = {
+		.p50 = samples[num / 2] / cycles_per_ns,
+		.p99 = samples[(uint32_t) (num * 0.99)] / cycles_per_ns,
+		.p999 = samples[(uint32_t) (num * 0.999)] / cycles_per_ns,
+		.max = samples[num - 1] / cycles_per_ns
+	};
+	free(samples);
+	return p;
+}
+
+static bool json_output;
+static bool first_record = true;
+
+static void print_record(const char* allocator, enum bench_pattern pattern, uint32_t num_threads, uint64_t ops,
+		double mops, uint64_t failures, struct percentiles alloc, struct percentiles free) {
+	if (json_output) {
+		printf("%s\n  {\"allocator\": \"%s\", \"pattern\": \"%s\", \"threads\": %u, \"ops\": %lu, \"mops\": %.3f, "
+			"\"failures\": %lu, \"alloc_ns\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}, "
+			"\"free_ns\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}",
+			first_record ? "" : ",", allocator, pattern_names[pattern], num_threads, ops, mops, failures,
+			alloc.p50, alloc.p99, alloc.p999, alloc.max, free.p50, free.p99, free.p999, free.max);
+	} else {
+		printf("\"%s\",%s,%u,%lu,%.3f,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+			allocator, pattern_names[pattern], num_threads, ops, mops, failures,
+			alloc.p50, alloc.p99, alloc.p999, alloc.max, free.p50, free.p99, free.p999, free.max);
+	}
+	first_record = false;
+	fflush(stdout);
+}
+
+static void run(const struct bench_config* config, enum bench_pattern pattern, uint32_t num_threads, uint32_t ops_per_thread) {
+	// enough entries that only the fallback configuration runs out of its primary
+	uint32_t num_entries = num_threads * (QUEUE_SIZE + SLOTS_PER_THREAD + BURST_SIZE);
+	struct bench_run run = {
+		.allocator = config->create(num_entries),
+		.pattern = pattern,
+		.num_threads = num_threads,
+		.ops_per_thread = ops_per_thread,
+		.queues = NULL,
+		.slots = NULL
+	};
+	if (pattern == PATTERN_PRODUCER_CONSUMER) {
+		run.queues = (struct bench_queue*) aligned_alloc(64, sizeof(struct bench_queue) * (num_threads / 2));
+		memset(run.queues, 0, sizeof(struct bench_queue) * (num_threads / 2));
+	} else if (pattern == PATTERN_ALL_TO_ALL) {
+		run.slots = (void**) calloc(num_threads * SLOTS_PER_THREAD, sizeof(void*));
+	}
+	struct bench_thread* threads = (struct bench_thread*) calloc(num_threads, sizeof(struct bench_thread));
+	pthread_barrier_init(&run.barrier, NULL, num_threads + 1);
+	for (uint32_t i = 0; i < num_threads; i++) {
+		threads[i].run = &run;
+		threads[i].id = i;
+		if (pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i])) {
+			error("failed to start benchmark thread");
+		}
+	}
+	pthread_barrier_wait(&run.barrier);
+	// the threads take the time themselves, the main thread may not run again before they are done
+	uint64_t start = UINT64_MAX;
+	uint64_t end = 0;
+	for (uint32_t i = 0; i < num_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		start = threads[i].start_time < start ? threads[i].start_time : start;
+		end = threads[i].end_time > end ? threads[i].end_time : end;
+	}
+	uint64_t time = end - start;
+	// only allocations count as operations, producer-consumer has half as many allocating threads
+	uint64_t ops = (uint64_t) ops_per_thread * (pattern == PATTERN_PRODUCER_CONSUMER ? num_threads / 2 : num_threads);
+	uint64_t failures = 0;
+	for (uint32_t i = 0; i < num_threads; i++) {
+		failures += threads[i].failures;
+	}
+	print_record(config->name, pattern, num_threads, ops, (double) ops / time * 1000, failures,
+		compute_percentiles(threads, num_threads, true), compute_percentiles(threads, num_threads, false));
+	if (run.slots) {
+		for (uint32_t i = 0; i < num_threads * SLOTS_PER_THREAD; i++) {
+			if (run.slots[i]) {
+				struct mem_blk blk = {run.slots[i], BLOCK_SIZE};
+				run.allocator->deallocate(run.allocator, &blk);
+			}
+		}
+	}
+	pthread_barrier_destroy(&run.barrier);
+	free(threads);
+	free(run.queues);
+	free(run.slots);
+	config->destroy(run.allocator);
+}
+
+int main(int argc, char* argv[]) {
+	int arg = 1;
+	if (argc > arg && !strcmp(argv[arg], "--json")) {
+		json_output = true;
+		arg++;
+	}
+	if (argc > arg + 2 || (argc > arg && argv[arg][0] == '-')) {
+		printf("Usage: %s [--json] [max threads] [operations per thread]\n", argv[0]);
+		return 1;
+	}
+	uint32_t max_threads = argc > arg ? (uint32_t) strtoul(argv[arg], NULL, 10) : DEFAULT_MAX_THREADS;
+	uint32_t ops_per_thread = argc > arg + 1 ? (uint32_t) strtoul(argv[arg + 1], NULL, 10) : DEFAULT_OPS_PER_THREAD;
+	calibrate_tsc();
+	if (json_output) {
+		printf("[");
+	} else {
+		printf("allocator,pattern,threads,ops,mops,failures,alloc_p50_ns,alloc_p99_ns,alloc_p999_ns,alloc_max_ns,"
+			"free_p50_ns,free_p99_ns,free_p999_ns,free_max_ns\n");
+	}
+	for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+		for (int pattern = 0; pattern < NUM_PATTERNS; pattern++) {
+			for (uint32_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+				// allocators that are not thread-safe only run the single-threaded case
+				if (!configs[c].thread_safe && (pattern != PATTERN_LOCAL || num_threads > 1)) {
+					continue;
+				}
+				if (pattern == PATTERN_PRODUCER_CONSUMER && num_threads < 2) {
+					continue;
+				}
+				run(&configs[c], (enum bench_pattern) pattern, num_threads, ops_per_thread);
+			}
+		}
+	}
+	if (json_output) {
+		printf("\n]\n");
+	}
+	return 0;
+}
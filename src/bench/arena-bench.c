@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "log.h"
+#include "allocator/allocator.h"
+
+// per-burst scratch memory: every packet of a burst allocates a few short-lived objects (parse results, temporary
+// headers) that all die at the end of the burst
+// compares malloc/free of every object to an arena that is reset once per burst, e.g.:
+// ./arena-bench 1000000
+
+#define BURST_SIZE 32
+#define OBJS_PER_PKT 3
+#define DEFAULT_NUM_BURSTS 1000000
+
+static const size_t obj_sizes[OBJS_PER_PKT] = {48, 96, 160};
+
+static uint64_t monotonic_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 * 1000 * 1000ULL + ts.tv_nsec;
+}
+
+// returns nanoseconds per allocation, including the cost of freeing it
+static double run(struct allocator* a, struct allocator* arena, uint32_t num_bursts) {
+	struct mem_blk blks[BURST_SIZE * OBJS_PER_PKT];
+	uint64_t sum = 0;
+	uint64_t start = monotonic_time();
+	for (uint32_t i = 0; i < num_bursts; i++) {
+		for (uint32_t j = 0; j < BURST_SIZE * OBJS_PER_PKT; j++) {
+			blks[j] = a->allocate(a, obj_sizes[j % OBJS_PER_PKT]);
+			if (!blks[j].ptr) {
+				error("allocation failed");
+			}
+			// touch the object like a parser would
+			*(volatile uint64_t*) blks[j].ptr = j;
+			sum += (uintptr_t) blks[j].ptr;
+		}
+		if (arena) {
+			arena_allocator_reset(arena);
+		} else {
+			for (uint32_t j = 0; j < BURST_SIZE * OBJS_PER_PKT; j++) {
+				a->deallocate(a, &blks[j]);
+			}
+		}
+	}
+	uint64_t time = monotonic_time() - start;
+	// keep the compiler from dropping the loop
+	if (sum == 42) {
+		printf("\n");
+	}
+	return (double) time / ((double) num_bursts * BURST_SIZE * OBJS_PER_PKT);
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t num_bursts = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : DEFAULT_NUM_BURSTS;
+	size_t arena_size = 0;
+	for (uint32_t i = 0; i < OBJS_PER_PKT; i++) {
+		arena_size += (obj_sizes[i] + 15) / 16 * 16 * BURST_SIZE;
+	}
+	// the parent only provides the memory once, use dma_allocator_t to put the arena into a huge page
+	struct allocator* arena = arena_allocator_new(arena_size, &mallocator_t);
+	printf("mallocator: %6.2f ns per object\n", run(&mallocator_t, NULL, num_bursts));
+	printf("arena:      %6.2f ns per object\n", run(arena, arena, num_bursts));
+	arena_allocator_free(arena);
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "log.h"
+#include "allocator/allocator.h"
+#include "allocator/policy_allocator.hpp"
+
+// the same composition of size classes built from the C allocators (every call goes through function pointers)
+// and from the policy templates (everything inlined), with the per-burst workload of arena-bench, e.g.:
+// ./policy-allocator-bench 1000000
+
+#define BURST_SIZE 32
+#define OBJS_PER_PKT 3
+#define DEFAULT_NUM_BURSTS 1000000
+#define ENTRIES_PER_CLASS (2 * BURST_SIZE * OBJS_PER_PKT)
+
+using namespace ixy::policy;
+
+static const size_t obj_sizes[OBJS_PER_PKT] = {48, 96, 160};
+
+// 64 and 256 byte stacks that fall back to malloc when they run empty, malloc for everything larger
+using policy_size_classes = segregator<64, fallback<stack<64, ENTRIES_PER_CLASS>, mallocator>,
+        segregator<256, fallback<stack<256, ENTRIES_PER_CLASS>, mallocator>, mallocator>>;
+
+static uint64_t monotonic_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ULL + ts.tv_nsec;
+}
+
+// returns nanoseconds per allocation, including the cost of freeing it
+template<typename Allocator>
+static double run(Allocator& a, uint32_t num_bursts) {
+    struct mem_blk blks[BURST_SIZE * OBJS_PER_PKT];
+    uint64_t sum = 0;
+    uint64_t start = monotonic_time();
+    for (uint32_t i = 0; i < num_bursts; i++) {
+        for (uint32_t j = 0; j < BURST_SIZE * OBJS_PER_PKT; j++) {
+            blks[j] = a.allocate(obj_sizes[j % OBJS_PER_PKT]);
+            if (!blks[j].ptr)
+                error("allocation failed");
+            // touch the object like a parser would
+            *(volatile uint64_t*) blks[j].ptr = j;
+            sum += (uintptr_t) blks[j].ptr;
+        }
+        for (uint32_t j = 0; j < BURST_SIZE * OBJS_PER_PKT; j++)
+            a.deallocate(&blks[j]);
+    }
+    uint64_t time = monotonic_time() - start;
+    // keep the compiler from dropping the loop
+    if (sum == 42)
+        printf("\n");
+    return (double) time / ((double) num_bursts * BURST_SIZE * OBJS_PER_PKT);
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t num_bursts = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : DEFAULT_NUM_BURSTS;
+
+    struct allocator* stack64 = stack_allocator_new(ENTRIES_PER_CLASS, 64, &mallocator_t);
+    struct allocator* stack256 = stack_allocator_new(ENTRIES_PER_CLASS, 256, &mallocator_t);
+    struct allocator* children[] = {
+            fallback_allocator_new(stack64, &mallocator_t),
+            fallback_allocator_new(stack256, &mallocator_t)
+    };
+    const size_t class_sizes[] = {64, 256};
+    struct allocator* c_size_classes = segregator_allocator_new(class_sizes, children, 2, &mallocator_t);
+    vtable_allocator c_allocator(c_size_classes);
+
+    auto policy_allocator = new policy_size_classes();
+
+    printf("C vtable:        %6.2f ns per object\n", run(c_allocator, num_bursts));
+    printf("policy template: %6.2f ns per object\n", run(*policy_allocator, num_bursts));
+
+    delete policy_allocator;
+    segregator_allocator_free(c_size_classes);
+    for (auto child : children)
+        fallback_allocator_free(child);
+    stack_allocator_free(stack64);
+    stack_allocator_free(stack256);
+    return 0;
+}
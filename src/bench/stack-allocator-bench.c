@@ -0,0 +1,89 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "log.h"
+#include "allocator/allocator.h"
+
+// compares the throughput of the spinlock and the lock-free stack allocator with 1 to 32 threads hammering one stack
+// every thread allocates a few blocks and frees them again, like a worker that handles a small burst, e.g.:
+// ./stack-allocator-bench 1000000
+
+#define BURST_SIZE 4
+#define ENTRY_SIZE 64
+#define DEFAULT_OPS_PER_THREAD 1000000
+#define MAX_THREADS 32
+
+struct bench_thread {
+	struct allocator* allocator;
+	uint32_t num_ops;
+	pthread_barrier_t* barrier;
+};
+
+static uint64_t monotonic_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 * 1000 * 1000ULL + ts.tv_nsec;
+}
+
+static void* bench_thread(void* arg) {
+	struct bench_thread* bt = (struct bench_thread*) arg;
+	struct allocator* a = bt->allocator;
+	pthread_barrier_wait(bt->barrier);
+	for (uint32_t i = 0; i < bt->num_ops; i += BURST_SIZE) {
+		struct mem_blk blks[BURST_SIZE];
+		for (uint32_t j = 0; j < BURST_SIZE; j++) {
+			blks[j] = a->allocate(a, ENTRY_SIZE);
+		}
+		for (uint32_t j = 0; j < BURST_SIZE; j++) {
+			if (blks[j].ptr) {
+				a->deallocate(a, &blks[j]);
+			}
+		}
+	}
+	return NULL;
+}
+
+// returns million alloc/free pairs per second summed over all threads
+static double run(struct allocator* a, uint32_t num_threads, uint32_t ops_per_thread) {
+	pthread_t threads[MAX_THREADS];
+	struct bench_thread args[MAX_THREADS];
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, num_threads + 1);
+	for (uint32_t i = 0; i < num_threads; i++) {
+		args[i] = (struct bench_thread) {
+			.allocator = a,
+			.num_ops = ops_per_thread,
+			.barrier = &barrier
+		};
+		if (pthread_create(&threads[i], NULL, bench_thread, &args[i])) {
+			error("failed to start benchmark thread");
+		}
+	}
+	pthread_barrier_wait(&barrier);
+	uint64_t start = monotonic_time();
+	for (uint32_t i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	uint64_t time = monotonic_time() - start;
+	pthread_barrier_destroy(&barrier);
+	return (double) ops_per_thread * num_threads / time * 1000;
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t ops_per_thread = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : DEFAULT_OPS_PER_THREAD;
+	// enough entries that no thread ever finds the stack empty, only the head is contended
+	uint32_t num_entries = MAX_THREADS * BURST_SIZE;
+	struct allocator* spinlock = spinlock_stack_allocator_new(num_entries, ENTRY_SIZE, &mallocator_t);
+	struct allocator* lockfree = lockfree_stack_allocator_new(num_entries, ENTRY_SIZE, &mallocator_t);
+	printf("threads   spinlock Mops   lock-free Mops\n");
+	for (uint32_t num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2) {
+		double spinlock_mops = run(spinlock, num_threads, ops_per_thread);
+		double lockfree_mops = run(lockfree, num_threads, ops_per_thread);
+		printf("%7u   %13.2f   %14.2f\n", num_threads, spinlock_mops, lockfree_mops);
+	}
+	spinlock_stack_allocator_free(spinlock);
+	lockfree_stack_allocator_free(lockfree);
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "memory.h"
+
+// emulates the memory traffic of full-rate rx on a large pool: buffers cycle through the whole pool (the ring of a
+// thread-safe pool is FIFO), the nic writes the first cache lines of every buffer and the cpu reads the headers
+// compares the default 2048 byte stride to a stride padded for the given number of memory channels and ranks, e.g.:
+// ./stride-bench 65536 4 2
+
+#define BATCH_SIZE 32
+#define PKT_SIZE 128
+#define NUM_BATCHES (4 * 1024 * 1024)
+
+static uint64_t monotonic_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 * 1000 * 1000ULL + ts.tv_nsec;
+}
+
+static void run(uint32_t num_bufs, uint32_t mem_channels, uint32_t mem_ranks) {
+	struct mempool_params params;
+	mempool_params_init(&params, num_bufs, 2048);
+	params.flags = MEMPOOL_F_MT;
+	params.mem_channels = mem_channels;
+	params.mem_ranks = mem_ranks;
+	struct mempool* mempool = memory_allocate_mempool_ext(&params);
+	struct pkt_buf* bufs[BATCH_SIZE];
+	uint64_t sum = 0;
+	uint64_t start = monotonic_time();
+	for (uint32_t i = 0; i < NUM_BATCHES; i++) {
+		uint32_t num = pkt_buf_alloc_batch(mempool, bufs, BATCH_SIZE);
+		for (uint32_t j = 0; j < num; j++) {
+			// the nic writes the packet, the cpu reads the ethernet header
+			memset(pkt_buf_data(bufs[j]), (int) i, PKT_SIZE);
+			bufs[j]->size = PKT_SIZE;
+			sum += pkt_buf_data(bufs[j])[12];
+		}
+		pkt_buf_free_batch(bufs, num);
+	}
+	uint64_t time = monotonic_time() - start;
+	double mpps = (double) NUM_BATCHES * BATCH_SIZE / time * 1000;
+	// header cache line + packet data
+	double bytes_per_pkt = 64 + PKT_SIZE;
+	printf("stride %4u bytes: %7.2f Mpps, %6.2f GB/s (checksum %lu)\n",
+		mempool->buf_size, mpps, mpps * bytes_per_pkt / 1000, sum);
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 4) {
+		printf("Usage: %s <number of buffers> <memory channels> <ranks per channel>\n", argv[0]);
+		return 1;
+	}
+	uint32_t num_bufs = (uint32_t) strtoul(argv[1], NULL, 10);
+	uint32_t mem_channels = (uint32_t) strtoul(argv[2], NULL, 10);
+	uint32_t mem_ranks = (uint32_t) strtoul(argv[3], NULL, 10);
+	run(num_bufs, 0, 0);
+	run(num_bufs, mem_channels, mem_ranks);
+	return 0;
+}
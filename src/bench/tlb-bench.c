@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "hugepage.h"
+#include "log.h"
+#include "memory.h"
+
+// measures dTLB misses of random buffer accesses in a large mempool-like memory area
+// compares 4 KB pages to the huge pages of the configured hugetlbfs mount, run it once with a 2 MB and once with a
+// 1 GB mount to compare them, e.g.:
+// IXY_HUGETLBFS=/mnt/huge ./tlb-bench 512 && IXY_HUGETLBFS=/mnt/huge-1G ./tlb-bench 512
+
+#define BUF_SIZE 2048
+#define DEFAULT_SIZE_MB 512
+#define NUM_ACCESSES (64 * 1024 * 1024)
+
+static int open_dtlb_counter() {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fd < 0) {
+		warn("dTLB miss counter not available, only reporting run time");
+	}
+	return fd;
+}
+
+static uint64_t monotonic_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 * 1000 * 1000ULL + ts.tv_nsec;
+}
+
+// touches the first cache line of randomly chosen buffers, this is what a driver does with the packet headers
+static void run(const char* name, uint8_t* mem, size_t size, int counter) {
+	uint64_t num_bufs = size / BUF_SIZE;
+	// warm up and make sure all pages are present
+	memset(mem, 1, size);
+	if (counter >= 0) {
+		ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	uint64_t start = monotonic_time();
+	uint64_t rand = 88172645463325252ULL;
+	uint64_t sum = 0;
+	for (uint32_t i = 0; i < NUM_ACCESSES; i++) {
+		// xorshift64
+		rand ^= rand << 13;
+		rand ^= rand >> 7;
+		rand ^= rand << 17;
+		sum += mem[(rand % num_bufs) * BUF_SIZE];
+	}
+	uint64_t time = monotonic_time() - start;
+	uint64_t misses = 0;
+	if (counter >= 0) {
+		ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(counter, &misses, sizeof(misses)) != sizeof(misses)) {
+			misses = 0;
+		}
+	}
+	printf("%-10s %8.2f ns/access", name, (double) time / NUM_ACCESSES);
+	if (counter >= 0) {
+		printf(" %8.4f dTLB misses/access", (double) misses / NUM_ACCESSES);
+	}
+	// prevent the loop from being optimized away
+	printf(" (checksum %lu)\n", sum);
+}
+
+int main(int argc, char* argv[]) {
+	size_t size_mb = DEFAULT_SIZE_MB;
+	if (argc > 1) {
+		size_mb = strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2 || !size_mb) {
+		printf("Usage: %s [size in MB]\n", argv[0]);
+		return 1;
+	}
+	size_t size = size_mb << 20;
+	int counter = open_dtlb_counter();
+
+	uint8_t* small_pages = (uint8_t*) check_err(mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0), "mmap");
+	// transparent huge pages would make the comparison pointless
+	madvise(small_pages, size, MADV_NOHUGEPAGE);
+	run("4 KB", small_pages, size, counter);
+	munmap(small_pages, size);
+
+	char name[32];
+	snprintf(name, sizeof(name), "%zu MB", hugepage_size() >> 20);
+	struct dma_memory huge_pages = memory_allocate_dma(size);
+	run(name, (uint8_t*) huge_pages.virt, size, counter);
+	return 0;
+}
@@ -8,10 +8,32 @@
 
 #define MAX_QUEUES 64
 
+struct allocator;
+
+// optional settings for the init functions of the drivers (e.g., ixgbe_init_ext()), see ixy_device_config_init()
+struct ixy_device_config {
+	// where all rx queues take their packet buffers from: a pool (mempool_allocator()) or a composition of pools,
+	// e.g., fallback_allocator_new() with a second pool that absorbs bursts; NULL to create a pool per queue
+	// the queues share it, so the pools must be MEMPOOL_F_MT if the queues are used by different threads
+	// every buffer needs room for a full frame after its headroom, the driver stops with an error otherwise
+	struct allocator* rx_allocator;
+	// opt-in: the pools the driver creates per rx queue are persistent pools named <rx_pool_name>-rx<queue id>
+	// (see mempool_params.name), a restarted application gets the same memory again; NULL for regular pools
+	// the name must be unique per device and can't be used by two processes at the same time; unused with rx_allocator
+	const char* rx_pool_name;
+};
+
+static inline void ixy_device_config_init(struct ixy_device_config* config) {
+	config->rx_allocator = NULL;
+	config->rx_pool_name = NULL;
+}
+
 struct ixy_device {
 	const char* pci_addr;
 	const char* driver_name;
 	uint8_t* addr;
+	// numa node of the nic, -1 if unknown; dma memory of the device is allocated on this node
+	int numa_node;
 	uint16_t num_rx_queues;
 	uint16_t num_tx_queues;
 	// allow drivers to keep some state for queues, opaque pointer cast by the driver
@@ -7,8 +7,19 @@
 
 #include "log.h"
 
+struct allocator;
+
 namespace ixy {
     constexpr int MAX_QUEUES = 64;
+
+    // optional settings for the driver constructors, same as struct ixy_device_config of the C drivers
+    struct device_config {
+        // where all rx queues take their packet buffers from: a pool (mempool_allocator()) or a composition of pools,
+        // nullptr to create a pool per queue; see ixy_device_config.rx_allocator
+        struct allocator* rx_allocator = nullptr;
+        // opt-in persistent pools for the rx queues, see ixy_device_config.rx_pool_name
+        const char* rx_pool_name = nullptr;
+    };
 }
 
 template<typename T>
@@ -25,6 +36,8 @@ public:
     std::uint16_t num_tx_queues;
     const char* pci_addr;
     std::uint8_t* addr;
+    // numa node of the nic, -1 if unknown; dma memory of the device is allocated on this node
+    int numa_node = -1;
     // allow drivers to keep some state for queues, opaque pointer cast by the driver
     void* rx_queues;
     void* tx_queues;
@@ -4,14 +4,38 @@
 // allocated for each rx queue, keeps state for the receive function
 struct ixgbe_rx_queue {
     volatile union ixgbe_adv_rx_desc* descriptors;
+    // buffers come from allocator, mempool is set if that is a plain pool and nullptr for a composition of pools
+    struct allocator* allocator;
     struct mempool* mempool;
+    // prefix of the name of the persistent pool the queue creates if there is no allocator, nullptr for a regular pool
+    const char* pool_name;
     uint16_t num_entries;
     // position we are reading from
     uint16_t rx_index;
+    // packets dropped because no replacement buffer could be allocated, collected by the stats functions
+    uint64_t rx_nombuf;
+    // replacement buffers for received packets, taken from the top
+    uint16_t stash_len;
+    struct pkt_buf* stash[ixgbe_driver::RX_STASH_SIZE];
     // virtual addresses to map descriptors back to their mbuf for freeing
     void* virtual_addresses[];
 };
 
+// allocates the next batch of replacement buffers, returns false if all pools are exhausted
+static bool refill_rx_stash(struct ixgbe_rx_queue* queue) {
+    queue->stash_len = (uint16_t) pkt_buf_alloc_batch_from(queue->allocator, queue->stash, ixgbe_driver::RX_STASH_SIZE);
+    // a plain pool was checked when the queue was started, the pools of a composition are only known once they
+    // hand out buffers
+    if (!queue->mempool) {
+        for (uint16_t i = 0; i < queue->stash_len; i++) {
+            if (pkt_buf_capacity(queue->stash[i]) < ixgbe_driver::MIN_RX_BUF_ROOM) {
+                error("rx buffers of pool %p are too small: room for %u bytes after the headroom, need %u", queue->stash[i]->mempool, pkt_buf_capacity(queue->stash[i]), ixgbe_driver::MIN_RX_BUF_ROOM);
+            }
+        }
+    }
+    return queue->stash_len > 0;
+}
+
 // allocated for each tx queue, keeps state for the transmit function
 struct ixgbe_tx_queue {
     volatile union ixgbe_adv_tx_desc* descriptors;
@@ -24,7 +48,7 @@ struct ixgbe_tx_queue {
     void* virtual_addresses[];
 };
 
-ixgbe::ixgbe(const char* pci_addr, uint16_t rx_queues, uint16_t tx_queues)
+ixgbe::ixgbe(const char* pci_addr, uint16_t rx_queues, uint16_t tx_queues, const ixy::device_config& config)
         : ixy_driver_base(pci_addr, rx_queues, tx_queues) {
     if (::getuid()) {
         warn("Not running as root, this will probably fail");
@@ -36,8 +60,14 @@ ixgbe::ixgbe(const char* pci_addr, uint16_t rx_queues, uint16_t tx_queues)
         error("cannot configure %d tx queues: limit is %d", tx_queues, ixy::MAX_QUEUES);
     }
     addr = ::pci_map_resource(pci_addr);
+    numa_node = ::pci_numa_node(pci_addr);
     this->rx_queues = ::calloc(rx_queues, sizeof(struct ixgbe_rx_queue) + sizeof(void*) * ixgbe_driver::MAX_RX_QUEUE_ENTRIES);
     this->tx_queues = ::calloc(rx_queues, sizeof(struct ixgbe_tx_queue) + sizeof(void*) * ixgbe_driver::MAX_TX_QUEUE_ENTRIES);
+    for (uint16_t i = 0; i < rx_queues; i++) {
+        struct ixgbe_rx_queue* queue = ((struct ixgbe_rx_queue*)(this->rx_queues)) + i;
+        queue->allocator = config.rx_allocator;
+        queue->pool_name = config.rx_pool_name ? strdup(config.rx_pool_name) : nullptr;
+    }
     reset_and_init();
 }
 
@@ -87,15 +117,22 @@ struct pkt_buf* ixgbe::rx_packet(std::uint16_t queue_id) {
         // this would be the place to implement RX offloading by translating the device-specific flags
         // to an independent representation in the buf (similiar to how DPDK works)
         // need a new mbuf for the descriptor
-        struct pkt_buf* new_buf = pkt_buf_alloc(queue->mempool);
+        struct pkt_buf* new_buf = nullptr;
+        if (queue->stash_len || refill_rx_stash(queue)) {
+            new_buf = queue->stash[--queue->stash_len];
+        }
         if (!new_buf) {
-            // we could handle empty mempools more gracefully here, but it would be quite messy...
-            // make your mempools large enough
-            error("failed to allocate new mbuf for rx, you are either leaking memory or your mempool is too small");
+            // all pools are exhausted, e.g., because the application holds on to buffers downstream
+            // drop the packet and give its buffer straight back to the nic, this keeps the ring filled and the
+            // hardware running instead of stalling the queue until buffers are returned
+            __atomic_fetch_add(&queue->rx_nombuf, 1, __ATOMIC_RELAXED);
+            new_buf = buf;
+            buf = NULL;
         }
         // reset the descriptor
-        desc_ptr->read.pkt_addr = new_buf->buf_addr_phy + offsetof(struct pkt_buf, data);
+        desc_ptr->read.pkt_addr = pkt_buf_data_phy(new_buf);
         desc_ptr->read.hdr_addr = 0; // this resets the flags
+        queue->virtual_addresses[rx_index] = new_buf;
         // want to read the next one next time
         queue->rx_index = inc_and_wrap_ring(rx_index, queue->num_entries);
         // tell hardware that we are done
@@ -127,14 +164,20 @@ uint16_t ixgbe::tx_packet(uint16_t queue_id, struct pkt_buf* buf) {
         uint32_t status = txd->wb.status;
         // hardware sets this flag as soon as it's sent out, we can give it back to the mempool
         if (status & IXGBE_ADVTXD_STAT_DD) {
-            struct pkt_buf* buf = (struct pkt_buf*) queue->virtual_addresses[clean_index];
-            pkt_buf_free(buf);
             clean_index = inc_and_wrap_ring(clean_index, queue->num_entries);
         } else {
             // reached an unsent descriptor, can't continue cleaning
             break;
         }
     }
+    // the sent buffers are contiguous in virtual_addresses, free them in one batch (two if the range wraps around)
+    struct pkt_buf** bufs = (struct pkt_buf**) queue->virtual_addresses;
+    if (clean_index >= queue->clean_index) {
+        pkt_buf_free_batch(bufs + queue->clean_index, clean_index - queue->clean_index);
+    } else {
+        pkt_buf_free_batch(bufs + queue->clean_index, queue->num_entries - queue->clean_index);
+        pkt_buf_free_batch(bufs, clean_index);
+    }
     queue->clean_index = clean_index;
 
     // step 2: send out our packet, if possible
@@ -147,7 +190,7 @@ uint16_t ixgbe::tx_packet(uint16_t queue_id, struct pkt_buf* buf) {
     queue->tx_index = inc_and_wrap_ring(queue->tx_index, queue->num_entries );
     volatile union ixgbe_adv_tx_desc* txd = queue->descriptors + cur_index;
     // NIC reads from here
-    txd->read.buffer_addr = buf->buf_addr_phy + offsetof(struct pkt_buf, data);
+    txd->read.buffer_addr = pkt_buf_data_phy(buf);
     // always the same flags: one buffer (EOP), advanced data descriptor, CRC offload, data length
     txd->read.cmd_type_len =
             IXGBE_ADVTXD_DCMD_EOP | IXGBE_ADVTXD_DCMD_RS | IXGBE_ADVTXD_DCMD_IFCS | IXGBE_ADVTXD_DCMD_DEXT | IXGBE_ADVTXD_DTYP_DATA | buf->size;
@@ -163,11 +206,18 @@ void ixgbe::do_read_stats(ixy::device_stats* stats) {
     uint32_t tx_pkts = get_reg32(IXGBE_GPTC);
     uint64_t rx_bytes = get_reg32(IXGBE_GORCL) + (((uint64_t) get_reg32(IXGBE_GORCH)) << 32);
     uint64_t tx_bytes = get_reg32(IXGBE_GOTCL) + (((uint64_t) get_reg32(IXGBE_GOTCH)) << 32);
+    // software counter, reset on read like the registers
+    uint64_t rx_nombuf = 0;
+    for (uint16_t i = 0; i < num_rx_queues; i++) {
+        struct ixgbe_rx_queue* queue = ((struct ixgbe_rx_queue*)(rx_queues)) + i;
+        rx_nombuf += __atomic_exchange_n(&queue->rx_nombuf, 0, __ATOMIC_RELAXED);
+    }
     if (stats) {
         stats->rx_pkts += rx_pkts;
         stats->tx_pkts += tx_pkts;
         stats->rx_bytes += rx_bytes;
         stats->tx_bytes += tx_bytes;
+        stats->rx_nombuf += rx_nombuf;
     }
 }
 
@@ -234,25 +284,45 @@ void ixgbe::start_rx_queue(int queue_id) {
     debug("starting rx queue %d", queue_id);
     struct ixgbe_rx_queue* queue = ((struct ixgbe_rx_queue*)(rx_queues)) + queue_id;
     // 2048 as pktbuf size is strictly speaking incorrect:
-    // we need a few headers (1 cacheline), so there's only 1984 bytes left for the device
+    // we need a few headers (1 cacheline) and the default headroom of 128 bytes, so there's only 1856 bytes left
+    // for the device
     // but the 82599 can only handle sizes in increments of 1 kb; but this is fine since our max packet size
     // is the default MTU of 1518
     // this has to be fixed if jumbo frames are to be supported
     // mempool should be >= the number of rx and tx descriptors for a forwarding application
-    queue->mempool = memory_allocate_mempool(4096, 2048);
+    // the application can provide the buffers instead, see ixy::device_config::rx_allocator
+    if (!queue->allocator) {
+        struct mempool_params params;
+        mempool_params_init(&params, 4096, 2048);
+        // only the buffers that are actually used are initialized, this keeps device initialization fast
+        params.flags = MEMPOOL_F_LAZY_INIT;
+        params.numa_node = numa_node;
+        char name[256];
+        if (queue->pool_name) {
+            if (snprintf(name, sizeof(name), "%s-rx%d", queue->pool_name, queue_id) >= (int) sizeof(name)) {
+                error("rx pool name %s too long", queue->pool_name);
+            }
+            params.name = name;
+        }
+        queue->allocator = mempool_allocator(memory_allocate_mempool_ext(&params));
+    }
+    queue->mempool = mempool_from_allocator(queue->allocator);
     if (queue->num_entries & (queue->num_entries - 1)) {
         error("number of queue entries must be a power of 2");
     }
+    // we need to return the virtual address in the rx function which the descriptor doesn't know by default
+    // so the buffers are allocated directly into the array of virtual addresses
+    struct pkt_buf** bufs = (struct pkt_buf**) queue->virtual_addresses;
+    if (pkt_buf_alloc_batch_from(queue->allocator, bufs, queue->num_entries) != queue->num_entries) {
+        error("failed to allocate rx descriptors");
+    }
     for (int i = 0; i < queue->num_entries; i++) {
-        volatile union ixgbe_adv_rx_desc* rxd = queue->descriptors + i;
-        struct pkt_buf* buf = pkt_buf_alloc(queue->mempool);
-        if (!buf) {
-            error("failed to allocate rx descriptor");
+        if (pkt_buf_capacity(bufs[i]) < ixgbe_driver::MIN_RX_BUF_ROOM) {
+            error("rx buffers of pool %p are too small: room for %u bytes after the headroom, need %u", bufs[i]->mempool, pkt_buf_capacity(bufs[i]), ixgbe_driver::MIN_RX_BUF_ROOM);
         }
-        rxd->read.pkt_addr = buf->buf_addr_phy;
+        volatile union ixgbe_adv_rx_desc* rxd = queue->descriptors + i;
+        rxd->read.pkt_addr = pkt_buf_data_phy(bufs[i]);
         rxd->read.hdr_addr = 0;
-        // we need to return the virtual address in the rx function which the descriptor doesn't know by default
-        queue->virtual_addresses[i] = buf;
     }
     // enable queue and wait if necessary
     set_flags32(IXGBE_RXDCTL(queue_id), IXGBE_RXDCTL_ENABLE);
@@ -290,7 +360,7 @@ void ixgbe::init_rx() {
         set_flags32(IXGBE_SRRCTL(i), IXGBE_SRRCTL_DROP_EN);
         // setup descriptor ring, see section 7.1.9
         uint32_t ring_size_bytes = ixgbe_driver::NUM_RX_QUEUE_ENTRIES * sizeof(union ixgbe_adv_rx_desc);
-        struct dma_memory mem = memory_allocate_dma(ring_size_bytes);
+        struct dma_memory mem = memory_allocate_dma_node(ring_size_bytes, numa_node);
         // neat trick from Snabb: initialize to 0xFF to prevent rogue memory accesses on premature DMA activation
         memset(mem.virt, -1, ring_size_bytes);
         set_reg32(IXGBE_RDBAL(i), (uint32_t) (mem.phy & 0xFFFFFFFFull));
@@ -340,7 +410,7 @@ void ixgbe::init_tx() {
 
         // setup descriptor ring, see section 7.1.9
         uint32_t ring_size_bytes = ixgbe_driver::NUM_TX_QUEUE_ENTRIES * sizeof(union ixgbe_adv_tx_desc);
-        struct dma_memory mem = memory_allocate_dma(ring_size_bytes);
+        struct dma_memory mem = memory_allocate_dma_node(ring_size_bytes, numa_node);
         memset(mem.virt, -1, ring_size_bytes);
         set_reg32(IXGBE_TDBAL(i), (uint32_t) (mem.phy & 0xFFFFFFFFull));
         set_reg32(IXGBE_TDBAH(i), (uint32_t) (mem.phy >> 32));
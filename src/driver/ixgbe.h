@@ -5,6 +5,7 @@
 #include "stats.h"
 
 struct ixy_device* ixgbe_init(const char* pci_addr, uint16_t rx_queues, uint16_t tx_queues);
+struct ixy_device* ixgbe_init_ext(const char* pci_addr, uint16_t rx_queues, uint16_t tx_queues, const struct ixy_device_config* config);
 uint32_t ixgbe_get_link_speed(const struct ixy_device* dev);
 void ixgbe_set_promisc(struct ixy_device* dev, bool enabled);
 struct pkt_buf* ixgbe_rx_packet(struct ixy_device* dev, uint16_t queue_id);
@@ -12,13 +12,20 @@ namespace ixgbe_driver {
 
     constexpr int NUM_RX_QUEUE_ENTRIES = 1024;
     constexpr int NUM_TX_QUEUE_ENTRIES = 1024;
+
+    // replacement buffers the rx path allocates at once, one batch per RX_STASH_SIZE received packets
+    constexpr int RX_STASH_SIZE = 32;
+
+    // largest frame the nic writes with the default max frame size, every rx buffer needs this much room after its headroom
+    constexpr std::uint32_t MIN_RX_BUF_ROOM = 1518;
 }
 
 class ixgbe : public ixy_driver_base<ixgbe> {
 public:
     const char* driver_name = "ixy-ixgbe";
 
-    explicit ixgbe(const char* pci_addr, uint16_t rx_queues, uint16_t tx_queues);
+    explicit ixgbe(const char* pci_addr, uint16_t rx_queues, uint16_t tx_queues,
+                   const ixy::device_config& config = ixy::device_config());
 
     std::uint32_t get_link_speed() const;
 
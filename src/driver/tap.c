@@ -0,0 +1,74 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/if_tun.h>
+
+#include "log.h"
+#include "tap.h"
+
+// brings the interface up, the kernel only hands us packets for interfaces that are up
+static void set_link_up(const char* ifname) {
+	int sock = check_err(socket(AF_INET, SOCK_DGRAM, 0), "open control socket");
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	memcpy(ifr.ifr_name, ifname, strlen(ifname) + 1);
+	check_err(ioctl(sock, SIOCGIFFLAGS, &ifr), "get tap interface flags");
+	ifr.ifr_flags |= IFF_UP;
+	check_err(ioctl(sock, SIOCSIFFLAGS, &ifr), "set tap interface up");
+	close(sock);
+}
+
+// creates (or attaches to) the tap interface ifname, the kernel picks a name if ifname is empty
+struct tap_device* tap_init(const char* ifname) {
+	// a truncated name would silently open or configure a different interface
+	if (strlen(ifname) >= IFNAMSIZ)
+		error("tap interface name %s is too long, at most %d characters are allowed", ifname, IFNAMSIZ - 1);
+	struct tap_device* tap = (struct tap_device*) malloc(sizeof(struct tap_device));
+	// non-blocking: the exception path polls the fd and must never hang in read() or write()
+	tap->fd = check_err(open("/dev/net/tun", O_RDWR | O_NONBLOCK), "open /dev/net/tun");
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	// raw ethernet frames without the additional packet information header
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	memcpy(ifr.ifr_name, ifname, strlen(ifname) + 1);
+	check_err(ioctl(tap->fd, TUNSETIFF, &ifr), "create tap interface");
+	memcpy(tap->name, ifr.ifr_name, IFNAMSIZ);
+	set_link_up(tap->name);
+	info("Created tap interface %s", tap->name);
+	return tap;
+}
+
+// receive up to num_frames frames from the kernel, non-blocking
+// each iovec describes the buffer for one frame, iov_len is updated to the received length
+// returns the number of frames received
+uint32_t tap_rx_batch(struct tap_device* tap, struct iovec* frames, uint32_t num_frames) {
+	// a tap fd always hands out exactly one frame per read, so batching happens here and not in the kernel
+	uint32_t num_rx = 0;
+	for (; num_rx < num_frames; num_rx++) {
+		ssize_t len = readv(tap->fd, &frames[num_rx], 1);
+		if (len < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				warn("failed to read from tap interface %s: %s", tap->name, strerror(errno));
+			}
+			break;
+		}
+		frames[num_rx].iov_len = (size_t) len;
+	}
+	return num_rx;
+}
+
+// hand up to num_frames frames to the kernel, non-blocking
+// returns the number of frames sent, frames that could not be sent are the caller's responsibility
+uint32_t tap_tx_batch(struct tap_device* tap, const struct iovec* frames, uint32_t num_frames) {
+	uint32_t num_tx = 0;
+	for (; num_tx < num_frames; num_tx++) {
+		if (writev(tap->fd, &frames[num_tx], 1) < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				warn("failed to write to tap interface %s: %s", tap->name, strerror(errno));
+			}
+			break;
+		}
+	}
+	return num_tx;
+}
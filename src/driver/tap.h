@@ -0,0 +1,18 @@
+#ifndef IXY_TAP_H
+#define IXY_TAP_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <net/if.h>
+
+// virtual port backed by a linux tap device, used to exchange packets with the kernel network stack
+struct tap_device {
+	int fd;
+	char name[IFNAMSIZ];
+};
+
+struct tap_device* tap_init(const char* ifname);
+uint32_t tap_rx_batch(struct tap_device* tap, struct iovec* frames, uint32_t num_frames);
+uint32_t tap_tx_batch(struct tap_device* tap, const struct iovec* frames, uint32_t num_frames);
+
+#endif //IXY_TAP_H
@@ -0,0 +1,279 @@
+#include <poll.h>
+#include <pthread.h>
+
+#include "exception_path.h"
+#include "libseccomp_init.h"
+#include "log.h"
+
+// number of slots per ring, must be a power of 2
+#define EXCEPTION_RING_SIZE 512
+// largest frame that can pass the exception path: 1500 byte MTU + ethernet and two vlan headers
+#define EXCEPTION_SLOT_SIZE 1536
+// frames handled per iteration of the exception thread
+#define EXCEPTION_BATCH_SIZE 32
+// the exception thread sleeps in poll() if there is nothing to do, bounds the latency for kernel-bound packets
+#define EXCEPTION_POLL_TIMEOUT_MS 1
+
+struct exception_slot {
+	uint32_t size;
+	uint8_t data[EXCEPTION_SLOT_SIZE];
+};
+
+// the producer only writes head, the consumer only writes tail; both are free-running counters
+// C11 stdatomic.h requires a too recent gcc, the __atomic builtins are available since gcc 4.7
+struct exception_ring {
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+	struct exception_slot slots[EXCEPTION_RING_SIZE] __attribute__((aligned(64)));
+};
+
+static struct exception_ring* exception_ring_alloc() {
+	struct exception_ring* ring = (struct exception_ring*) aligned_alloc(64, sizeof(struct exception_ring));
+	if (!ring) {
+		error("failed to allocate exception ring");
+	}
+	ring->head = 0;
+	ring->tail = 0;
+	return ring;
+}
+
+static inline struct exception_slot* exception_ring_slot(struct exception_ring* ring, uint32_t index) {
+	return &ring->slots[index & (EXCEPTION_RING_SIZE - 1)];
+}
+
+// number of filled slots as seen by the consumer
+static inline uint32_t exception_ring_count(struct exception_ring* ring) {
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail;
+}
+
+// number of empty slots as seen by the producer
+static inline uint32_t exception_ring_free(struct exception_ring* ring) {
+	return EXCEPTION_RING_SIZE - (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+}
+
+static inline uint16_t read_be16(const uint8_t* ptr) {
+	return (uint16_t) (ptr[0] << 8 | ptr[1]);
+}
+
+// decides if a packet needs to be handled by the kernel instead of the fast path
+// this is intentionally a simple header inspection: ARP, ICMP, routing protocols, and everything the
+// forwarder can't handle by itself (packets with an expiring ttl that need an ICMP error)
+bool exception_path_is_slow_path(const struct pkt_buf* buf) {
+	const uint8_t* pkt = pkt_buf_data(buf);
+	uint32_t len = buf->size;
+	if (len < 14) {
+		return false;
+	}
+	uint16_t ether_type = read_be16(pkt + 12);
+	uint32_t l3_offset = 14;
+	// skip vlan tags (802.1Q and QinQ)
+	while ((ether_type == 0x8100 || ether_type == 0x88A8) && len >= l3_offset + 4) {
+		ether_type = read_be16(pkt + l3_offset + 2);
+		l3_offset += 4;
+	}
+	const uint8_t* l3 = pkt + l3_offset;
+	uint32_t l3_len = len - l3_offset;
+	uint8_t proto;
+	const uint8_t* l4;
+	uint32_t l4_len;
+	switch (ether_type) {
+		case 0x0806: // ARP
+		case 0x8809: // slow protocols (LACP)
+		case 0x88CC: // LLDP
+			return true;
+		case 0x0800: { // IPv4
+			if (l3_len < 20) {
+				return false;
+			}
+			uint32_t ihl = (l3[0] & 0x0F) * 4;
+			if (l3[8] <= 1) {
+				return true;
+			}
+			proto = l3[9];
+			l4 = l3 + ihl;
+			// only the first fragment carries the transport header
+			l4_len = (read_be16(l3 + 6) & 0x1FFF) || l3_len < ihl ? 0 : l3_len - ihl;
+			break;
+		}
+		case 0x86DD: // IPv6, extension headers are not parsed
+			if (l3_len < 40) {
+				return false;
+			}
+			if (l3[7] <= 1) {
+				return true;
+			}
+			proto = l3[6];
+			l4 = l3 + 40;
+			l4_len = l3_len - 40;
+			break;
+		default:
+			return false;
+	}
+	switch (proto) {
+		case 1: // ICMP
+		case 2: // IGMP
+		case 58: // ICMPv6, includes neighbor discovery
+		case 89: // OSPF
+		case 103: // PIM
+		case 112: // VRRP
+			return true;
+		case 6: // TCP
+			// BGP, we only need to look at the ports here
+			return l4_len >= 4 && (read_be16(l4) == 179 || read_be16(l4 + 2) == 179);
+		case 17: { // UDP
+			if (l4_len < 4) {
+				return false;
+			}
+			uint16_t dst_port = read_be16(l4 + 2);
+			// DHCP, RIP, DHCPv6, BFD
+			return dst_port == 67 || dst_port == 68 || dst_port == 520 || dst_port == 546 || dst_port == 547
+				|| dst_port == 3784;
+		}
+		default:
+			return false;
+	}
+}
+
+// moves all slow-path packets out of bufs and queues a copy of them for the kernel, bufs is compacted in place
+// never blocks: packets are dropped if the exception thread can't keep up
+// the diverted buffers are returned to their mempool immediately, so mempools stay single-threaded
+// returns the number of packets left in bufs for the fast path
+uint32_t exception_path_divert(struct exception_path* ep, struct pkt_buf* bufs[], uint32_t num_bufs) {
+	struct exception_ring* ring = ep->to_kernel;
+	uint32_t head = ring->head;
+	uint32_t free_slots = exception_ring_free(ring);
+	uint32_t num_kept = 0;
+	for (uint32_t i = 0; i < num_bufs; i++) {
+		struct pkt_buf* buf = bufs[i];
+		if (!exception_path_is_slow_path(buf)) {
+			bufs[num_kept++] = buf;
+			continue;
+		}
+		if (free_slots && buf->size <= EXCEPTION_SLOT_SIZE) {
+			struct exception_slot* slot = exception_ring_slot(ring, head++);
+			memcpy(slot->data, pkt_buf_data(buf), buf->size);
+			slot->size = buf->size;
+			free_slots--;
+		} else {
+			ep->to_kernel_drops++;
+		}
+		pkt_buf_free(buf);
+	}
+	// publish all slots at once, the exception thread may only see them after the copies are done
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+	return num_kept;
+}
+
+// fetches up to num_bufs packets sent by the kernel, the packets are copied into buffers allocated from mempool
+// returns the number of packets placed in bufs, these need to be transmitted (or freed) by the caller
+uint32_t exception_path_fetch(struct exception_path* ep, struct mempool* mempool, struct pkt_buf* bufs[], uint32_t num_bufs) {
+	struct exception_ring* ring = ep->from_kernel;
+	uint32_t tail = ring->tail;
+	uint32_t available = exception_ring_count(ring);
+	uint32_t num_fetched = 0;
+	while (num_fetched < available && num_fetched < num_bufs) {
+		struct pkt_buf* buf = pkt_buf_alloc(mempool);
+		if (!buf) {
+			// try again later, the packets stay in the ring
+			break;
+		}
+		struct exception_slot* slot = exception_ring_slot(ring, tail++);
+		// the whole buffer is available for the copy, whatever packet it carried before
+		if (slot->size > pkt_buf_capacity(buf)) {
+			// the buffers of this mempool are too small (or have too much headroom) for the packet
+			ep->fetch_drops++;
+			pkt_buf_free(buf);
+			available--;
+			continue;
+		}
+		memcpy(pkt_buf_data(buf), slot->data, slot->size);
+		buf->size = slot->size;
+		bufs[num_fetched++] = buf;
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	return num_fetched;
+}
+
+// data plane -> kernel
+static uint32_t forward_to_kernel(struct exception_path* ep) {
+	struct exception_ring* ring = ep->to_kernel;
+	uint32_t num = exception_ring_count(ring);
+	num = num < EXCEPTION_BATCH_SIZE ? num : EXCEPTION_BATCH_SIZE;
+	if (!num) {
+		return 0;
+	}
+	struct iovec frames[EXCEPTION_BATCH_SIZE];
+	for (uint32_t i = 0; i < num; i++) {
+		struct exception_slot* slot = exception_ring_slot(ring, ring->tail + i);
+		frames[i].iov_base = slot->data;
+		frames[i].iov_len = slot->size;
+	}
+	// frames the kernel doesn't accept are dropped, the tap queue is full in that case anyways
+	tap_tx_batch(ep->tap, frames, num);
+	__atomic_store_n(&ring->tail, ring->tail + num, __ATOMIC_RELEASE);
+	return num;
+}
+
+// kernel -> data plane
+static uint32_t receive_from_kernel(struct exception_path* ep) {
+	struct exception_ring* ring = ep->from_kernel;
+	uint32_t num = exception_ring_free(ring);
+	num = num < EXCEPTION_BATCH_SIZE ? num : EXCEPTION_BATCH_SIZE;
+	struct iovec frames[EXCEPTION_BATCH_SIZE];
+	if (!num) {
+		// data plane is not fetching packets, read and drop one frame to keep the tap queue moving
+		uint8_t scratch[EXCEPTION_SLOT_SIZE];
+		frames[0].iov_base = scratch;
+		frames[0].iov_len = sizeof(scratch);
+		uint32_t dropped = tap_rx_batch(ep->tap, frames, 1);
+		ep->from_kernel_drops += dropped;
+		return dropped;
+	}
+	for (uint32_t i = 0; i < num; i++) {
+		struct exception_slot* slot = exception_ring_slot(ring, ring->head + i);
+		frames[i].iov_base = slot->data;
+		frames[i].iov_len = EXCEPTION_SLOT_SIZE;
+	}
+	uint32_t num_rx = tap_rx_batch(ep->tap, frames, num);
+	for (uint32_t i = 0; i < num_rx; i++) {
+		exception_ring_slot(ring, ring->head + i)->size = (uint32_t) frames[i].iov_len;
+	}
+	__atomic_store_n(&ring->head, ring->head + num_rx, __ATOMIC_RELEASE);
+	return num_rx;
+}
+
+static void* exception_thread(void* arg) {
+	struct exception_path* ep = (struct exception_path*) arg;
+	// seccomp filters are per-thread: only this thread gets access to the tap fd
+	setup_seccomp_exception_path(ep->tap->fd);
+	struct pollfd pfd = {
+		.fd = ep->tap->fd,
+		.events = POLLIN
+	};
+	while (true) {
+		uint32_t work = forward_to_kernel(ep);
+		work += receive_from_kernel(ep);
+		if (!work) {
+			poll(&pfd, 1, EXCEPTION_POLL_TIMEOUT_MS);
+		}
+	}
+	return NULL;
+}
+
+// creates the tap interface ifname and starts the exception thread
+// must be called before setup_seccomp() because threads inherit the seccomp filter of their creator
+struct exception_path* exception_path_start(const char* ifname) {
+	struct exception_path* ep = (struct exception_path*) malloc(sizeof(struct exception_path));
+	ep->tap = tap_init(ifname);
+	ep->to_kernel = exception_ring_alloc();
+	ep->from_kernel = exception_ring_alloc();
+	ep->to_kernel_drops = 0;
+	ep->from_kernel_drops = 0;
+	ep->fetch_drops = 0;
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, exception_thread, ep)) {
+		error("failed to start exception thread");
+	}
+	pthread_detach(thread);
+	return ep;
+}
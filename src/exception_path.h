@@ -0,0 +1,42 @@
+#ifndef IXY_EXCEPTION_PATH_H
+#define IXY_EXCEPTION_PATH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+#include "driver/tap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct exception_ring;
+
+// slow-path packets (ARP, ICMP, routing protocols, ...) are passed to the kernel via a tap device
+// the data plane and the tap device are decoupled by two single-producer/single-consumer rings,
+// all syscalls happen in a separate exception thread so the data plane never blocks
+struct exception_path {
+	struct tap_device* tap;
+	// data plane -> kernel, drained by the exception thread
+	struct exception_ring* to_kernel;
+	// kernel -> data plane, filled by the exception thread
+	struct exception_ring* from_kernel;
+	// packets dropped because a ring was full, to_kernel_drops is only written by the data plane
+	uint64_t to_kernel_drops;
+	uint64_t from_kernel_drops;
+	// packets from the kernel that did not fit into a buffer of the mempool passed to exception_path_fetch()
+	// only written by the data plane
+	uint64_t fetch_drops;
+};
+
+struct exception_path* exception_path_start(const char* ifname);
+bool exception_path_is_slow_path(const struct pkt_buf* buf);
+uint32_t exception_path_divert(struct exception_path* ep, struct pkt_buf* bufs[], uint32_t num_bufs);
+uint32_t exception_path_fetch(struct exception_path* ep, struct mempool* mempool, struct pkt_buf* bufs[], uint32_t num_bufs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //IXY_EXCEPTION_PATH_H
@@ -0,0 +1,254 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <linux/limits.h>
+#include <linux/magic.h>
+#include <linux/mempolicy.h>
+
+#include "hugepage.h"
+#include "log.h"
+#include "allocator/rte_spinlock.h"
+
+static char hugetlbfs_mount[PATH_MAX];
+// page size of the mount, 0 until the mount was checked
+static size_t hugetlbfs_page_size;
+
+static uint32_t huge_pg_id;
+
+// number of translations that are cached, must be a power of 2
+#define PHYS_CACHE_SIZE 4096
+// translations are cached with the granularity of the smallest huge page size (2 MB), this is also correct for 1 GB
+// pages because they are aligned and contiguous
+#define PHYS_CACHE_PAGE_BITS 21
+#define PHYS_CACHE_PAGE_SIZE (1 << PHYS_CACHE_PAGE_BITS)
+
+// physical address of a huge page, resolved once via pagemap
+// a huge page is physically contiguous, so every address inside it can be translated with simple arithmetic
+struct phys_cache_entry {
+	uintptr_t virt_page;
+	uintptr_t phys_page;
+};
+
+// direct-mapped by virtual page number: consecutive pages of a mapping never evict each other
+static struct phys_cache_entry phys_cache[PHYS_CACHE_SIZE];
+static rte_spinlock_t phys_cache_lock = RTE_SPINLOCK_INITIALIZER;
+
+// opened once and kept open, opening pagemap for every translation is slow
+static int pagemap_fd = -1;
+// process that opened pagemap_fd, a forked child inherits the fd but it still shows the page table of its parent
+static pid_t pagemap_pid;
+
+// use the hugetlbfs mounted at path for all following allocations, e.g., a mount with 1 GB pages
+// memory that was already allocated is not affected
+void hugepage_set_mount(const char* path) {
+	if (strlen(path) >= sizeof(hugetlbfs_mount)) {
+		error("hugetlbfs mount path %s too long", path);
+	}
+	strcpy(hugetlbfs_mount, path);
+	hugetlbfs_page_size = 0;
+}
+
+// page size of the configured hugetlbfs mount, detected at runtime
+size_t hugepage_size() {
+	if (hugetlbfs_page_size) {
+		return hugetlbfs_page_size;
+	}
+	if (!hugetlbfs_mount[0]) {
+		const char* env = getenv("IXY_HUGETLBFS");
+		hugepage_set_mount(env && env[0] ? env : HUGETLBFS_DEFAULT_MOUNT);
+	}
+	struct statfs fs;
+	if (statfs(hugetlbfs_mount, &fs)) {
+		error("failed to stat %s, check that hugetlbfs is mounted (see setup-hugetlbfs.sh)", hugetlbfs_mount);
+	}
+	if (fs.f_type != HUGETLBFS_MAGIC) {
+		error("%s is not a hugetlbfs mount", hugetlbfs_mount);
+	}
+	if (fs.f_bsize < PHYS_CACHE_PAGE_SIZE || fs.f_bsize % PHYS_CACHE_PAGE_SIZE) {
+		error("unsupported huge page size %ld of %s", (long) fs.f_bsize, hugetlbfs_mount);
+	}
+	hugetlbfs_page_size = (size_t) fs.f_bsize;
+	info("using %zu MB huge pages from %s", hugetlbfs_page_size >> 20, hugetlbfs_mount);
+	return hugetlbfs_page_size;
+}
+
+// maps size bytes of the hugetlbfs file fd, the file must already have this size
+static void* map_huge_page_file(int fd, size_t size, int numa_node) {
+	void* virt_addr = (void*) check_err(mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_HUGETLB, fd, 0), "mmap hugepage");
+	// the policy must be set before mlock() faults in the pages
+	hugepage_bind_node(virt_addr, size, numa_node);
+	// never swap out DMA memory
+	check_err(mlock(virt_addr, size), "disable swap for DMA memory");
+	// touch every page so they are not lazily allocated and virt_to_phys() can resolve their address
+	for (size_t offset = 0; offset < size; offset += hugetlbfs_page_size) {
+		volatile uint8_t* page = ((volatile uint8_t*) virt_addr) + offset;
+		page[0] = page[0];
+	}
+	if (numa_node >= 0 && hugepage_get_node(virt_addr) != numa_node) {
+		warn("could not allocate huge pages on numa node %d, check /sys/devices/system/node/node%d/hugepages",
+			numa_node, numa_node);
+	}
+	return virt_addr;
+}
+
+// map size bytes of huge pages, size must be a multiple of hugepage_size()
+// numa_node can be -1 to use whatever node the kernel picks
+// (not using anonymous hugepages because madvise might fail in subtle ways with some kernel configurations)
+void* hugepage_map(size_t size, int numa_node) {
+	if (size % hugepage_size()) {
+		error("size %zu is not a multiple of the huge page size %zu", size, hugepage_size());
+	}
+	// C11 stdatomic.h requires a too recent gcc, we want to support gcc 4.8
+	uint32_t id = __sync_fetch_and_add(&huge_pg_id, 1);
+	char path[PATH_MAX];
+	if (snprintf(path, PATH_MAX, "%s/ixy-%d-%d", hugetlbfs_mount, getpid(), id) >= PATH_MAX) {
+		error("hugetlbfs mount path %s too long", hugetlbfs_mount);
+	}
+	// temporary file, will be deleted to prevent leaks of persistent pages
+	int fd = check_err(open(path, O_CREAT | O_RDWR, S_IRWXU), "open hugetlbfs file, check that hugetlbfs is mounted");
+	check_err(ftruncate(fd, (off_t) size), "allocate huge page memory, check hugetlbfs configuration");
+	void* virt_addr = map_huge_page_file(fd, size, numa_node);
+	// don't keep it around in the hugetlbfs
+	close(fd);
+	unlink(path);
+	return virt_addr;
+}
+
+static void persistent_path(char* path, const char* name) {
+	if (strchr(name, '/')) {
+		error("invalid name %s for persistent huge pages", name);
+	}
+	if (snprintf(path, PATH_MAX, "%s/ixy-persistent-%s", hugetlbfs_mount, name) >= PATH_MAX) {
+		error("hugetlbfs path for %s too long", name);
+	}
+}
+
+// like hugepage_map() but the memory is backed by the named file <mount>/ixy-persistent-<name> that is kept after
+// the process exits, a restarted process gets the same physical memory with its content when mapping it again
+// sets *attached to true if an existing file of the same size was mapped, the file is (re-)created otherwise
+// the file is locked until the process exits, a second mapping of the same name fails instead of sharing the memory
+void* hugepage_map_persistent(const char* name, size_t size, int numa_node, bool* attached) {
+	if (size % hugepage_size()) {
+		error("size %zu is not a multiple of the huge page size %zu", size, hugepage_size());
+	}
+	char path[PATH_MAX];
+	persistent_path(path, name);
+	int fd = check_err(open(path, O_CREAT | O_RDWR, S_IRWXU), "open hugetlbfs file, check that hugetlbfs is mounted");
+	// the lock belongs to this open file, so fd is never closed; it also excludes a second mapping in this process
+	if (flock(fd, LOCK_EX | LOCK_NB)) {
+		if (errno == EWOULDBLOCK) {
+			error("persistent memory %s (%s) is in use by another process or pool", name, path);
+		}
+		error("failed to lock %s: %s", path, strerror(errno));
+	}
+	struct stat stat;
+	check_err(fstat(fd, &stat), "stat hugetlbfs file");
+	*attached = (size_t) stat.st_size == size;
+	if (!*attached) {
+		if (stat.st_size) {
+			warn("persistent memory %s has size %zu instead of %zu, recreating it", name, (size_t) stat.st_size, size);
+			check_err(ftruncate(fd, 0), "free persistent huge page memory");
+		}
+		check_err(ftruncate(fd, (off_t) size), "allocate huge page memory, check hugetlbfs configuration");
+	}
+	return map_huge_page_file(fd, size, numa_node);
+}
+
+// deletes the named file, the huge pages are released once no process maps them anymore
+void hugepage_unlink_persistent(const char* name) {
+	char path[PATH_MAX];
+	// resolves the mount if nothing was mapped yet
+	hugepage_size();
+	persistent_path(path, name);
+	if (unlink(path) && errno != ENOENT) {
+		warn("failed to delete %s: %s", path, strerror(errno));
+	}
+}
+
+// translate a virtual address to a physical one via /proc/self/pagemap
+static uintptr_t pagemap_lookup(void* virt) {
+	long pagesize = sysconf(_SC_PAGESIZE);
+	if (pagemap_fd < 0 || pagemap_pid != getpid()) {
+		if (pagemap_fd >= 0) {
+			close(pagemap_fd);
+		}
+		pagemap_fd = check_err(open("/proc/self/pagemap", O_RDONLY), "getting pagemap");
+		pagemap_pid = getpid();
+	}
+	// pagemap is an array of pointers for each 4096 byte page
+	uint64_t phy = 0;
+	off_t offset = (off_t) ((uintptr_t) virt / pagesize * sizeof(phy));
+	if (check_err(pread(pagemap_fd, &phy, sizeof(phy), offset), "translating address") != sizeof(phy)) {
+		error("short read from pagemap for virtual address %p", virt);
+	}
+	// bits 0-54 are the page number
+	uint64_t pfn = phy & 0x7fffffffffffffULL;
+	if (!pfn) {
+		debug("page info for %p:\n"
+			"\tpfn: %lu\n"
+			"\tsoft-dirty: %lu\n"
+			"\texclusive: %lu\n"
+			"\tfile-page: %lu\n"
+			"\tswapped: %lu\n"
+			"\tpresent: %lu",
+			virt, pfn, (phy >> 55) & 1, (phy >> 56) & 1, (phy >> 61) & 1, (phy >> 62) & 1, (phy >> 63) & 1
+		);
+		error("failed to translate virtual address %p to physical address", virt);
+	}
+	return pfn * pagesize + ((uintptr_t) virt) % pagesize;
+}
+
+// translate a virtual address in huge page memory to a physical one
+// only the first translation for each huge page reads pagemap, this makes translating every buffer of a pool cheap
+// must only be used for memory backed by huge pages
+uintptr_t virt_to_phys(void* virt) {
+	uintptr_t virt_page = ((uintptr_t) virt) & ~((uintptr_t) PHYS_CACHE_PAGE_SIZE - 1);
+	uintptr_t offset = ((uintptr_t) virt) - virt_page;
+	struct phys_cache_entry* entry = &phys_cache[(virt_page >> PHYS_CACHE_PAGE_BITS) & (PHYS_CACHE_SIZE - 1)];
+	rte_spinlock_lock(&phys_cache_lock);
+	if (entry->virt_page != virt_page) {
+		entry->phys_page = pagemap_lookup((void*) virt_page);
+		entry->virt_page = virt_page;
+	}
+	uintptr_t phys = entry->phys_page + offset;
+	rte_spinlock_unlock(&phys_cache_lock);
+	return phys;
+}
+
+// drop cached translations for a range of huge page memory, must be called before the memory is unmapped
+void virt_to_phys_invalidate(void* virt, size_t size) {
+	uintptr_t start = ((uintptr_t) virt) & ~((uintptr_t) PHYS_CACHE_PAGE_SIZE - 1);
+	rte_spinlock_lock(&phys_cache_lock);
+	for (uintptr_t virt_page = start; virt_page < (uintptr_t) virt + size; virt_page += PHYS_CACHE_PAGE_SIZE) {
+		struct phys_cache_entry* entry = &phys_cache[(virt_page >> PHYS_CACHE_PAGE_BITS) & (PHYS_CACHE_SIZE - 1)];
+		if (entry->virt_page == virt_page) {
+			entry->virt_page = 0;
+		}
+	}
+	rte_spinlock_unlock(&phys_cache_lock);
+}
+
+// ask the kernel to back the mapping with pages from numa_node, must be called before the pages are touched
+// this only sets a preference: the allocation still succeeds if the node has no free huge pages left
+// (libnuma is not used to avoid the dependency, mbind is a simple syscall)
+void hugepage_bind_node(void* virt, size_t size, int numa_node) {
+	if (numa_node < 0) {
+		return;
+	}
+	if (numa_node >= MAX_NUMA_NODES) {
+		error("numa node %d out of range, limit is %d", numa_node, MAX_NUMA_NODES - 1);
+	}
+	unsigned long node_mask = 1UL << numa_node;
+	check_err(syscall(SYS_mbind, virt, size, MPOL_PREFERRED, &node_mask, MAX_NUMA_NODES + 1, 0), "mbind huge page memory");
+}
+
+// numa node of the page backing virt, the page must be present
+int hugepage_get_node(void* virt) {
+	int node = -1;
+	check_err(syscall(SYS_get_mempolicy, &node, NULL, 0, virt, MPOL_F_NODE | MPOL_F_ADDR), "get numa node of memory");
+	return node;
+}
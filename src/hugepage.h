@@ -0,0 +1,35 @@
+#ifndef IXY_HUGEPAGE_H
+#define IXY_HUGEPAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// hugetlbfs mount used for DMA memory unless changed by hugepage_set_mount() or the IXY_HUGETLBFS environment variable
+// the page size (2 MB or 1 GB on x86) is taken from the mount, use "mount -t hugetlbfs -o pagesize=1G" for 1 GB pages
+#define HUGETLBFS_DEFAULT_MOUNT "/mnt/huge"
+
+void hugepage_set_mount(const char* path);
+size_t hugepage_size();
+void* hugepage_map(size_t size, int numa_node);
+void* hugepage_map_persistent(const char* name, size_t size, int numa_node, bool* attached);
+void hugepage_unlink_persistent(const char* name);
+
+uintptr_t virt_to_phys(void* virt);
+void virt_to_phys_invalidate(void* virt, size_t size);
+
+// largest NUMA node id + 1 that can be requested, node -1 means no preference
+#define MAX_NUMA_NODES 64
+
+void hugepage_bind_node(void* virt, size_t size, int numa_node);
+int hugepage_get_node(void* virt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //IXY_HUGEPAGE_H
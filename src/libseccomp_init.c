@@ -29,3 +29,51 @@ void setup_seccomp() {
     seccomp_release(ctx);
 #endif  // IXY_NO_SECCOMP
 }
+
+// filter for the exception path thread, seccomp filters only apply to the calling thread
+// the data plane thread keeps its strict filter, only this thread may talk to the tap device
+void setup_seccomp_exception_path(int tap_fd) {
+#ifndef IXY_NO_SECCOMP
+    scmp_filter_ctx ctx;
+    // kill the whole process: killing only this thread would silently stop the exception path
+    // while the data plane keeps running and filling the ring to the kernel
+    ctx = seccomp_init(SCMP_ACT_KILL_PROCESS);
+    if (ctx == NULL) {
+        error("Failed to init seccomp filter context");
+    }
+    /* Add rules */
+    if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(readv), 1,
+                         SCMP_A0(SCMP_CMP_EQ, tap_fd))) {
+        error("add rule");
+    }
+    if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(writev), 1,
+                         SCMP_A0(SCMP_CMP_EQ, tap_fd))) {
+        error("add rule");
+    }
+    // newer glibc versions implement poll() via ppoll
+    if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(poll), 0)) {
+        error("add rule");
+    }
+    if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(ppoll), 0)) {
+        error("add rule");
+    }
+    // logging
+    if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(write), 1,
+                         SCMP_A0(SCMP_CMP_EQ, STDOUT_FILENO))) {
+        error("add rule");
+    }
+    if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(write), 1,
+                         SCMP_A0(SCMP_CMP_EQ, STDERR_FILENO))) {
+        error("add rule");
+    }
+    // stdio locks may be contended with the data plane thread
+    if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(futex), 0)) {
+        error("add rule");
+    }
+
+    if (seccomp_load(ctx)) {
+        error("add rule");
+    }
+    seccomp_release(ctx);
+#endif  // IXY_NO_SECCOMP
+}
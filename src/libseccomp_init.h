@@ -13,6 +13,7 @@ extern "C" {
 #endif //IXY_NO_SECCOMP
 
 void setup_seccomp();
+void setup_seccomp_exception_path(int tap_fd);
 
 #ifdef __cplusplus
 }
@@ -1,99 +1,755 @@
 #include "memory.h"
+#include "hugepage.h"
+#include "ring.h"
 #include "log.h"
+#include "allocator/allocator_common.h"
+#include "allocator/rte_per_lcore.h"
+#include "allocator/rte_spinlock.h"
 
 #include <stddef.h>
-#include <linux/limits.h>
 #include <stdio.h>
-#include <fcntl.h>
 #include <unistd.h>
-#include <sys/mman.h>
+#include <pthread.h>
 
-// translate a virtual address to a physical one via /proc/self/pagemap
-static uintptr_t virt_to_phys(void* virt) {
-	long pagesize = sysconf(_SC_PAGESIZE);
-	int fd = check_err(open("/proc/self/pagemap", O_RDONLY), "getting pagemap");
-	// pagemap is an array of pointers for each 4096 byte page
-	check_err(lseek(fd, (uintptr_t) virt / pagesize * sizeof(uintptr_t), SEEK_SET), "getting pagemap");
-	uintptr_t phy = 0;
-	check_err(read(fd, &phy, sizeof(phy)), "translating address");
-	close(fd);
-	if (!phy) {
-		error("failed to translate virtual address %p to physical address", virt);
-	}
-	// bits 0-54 are the page number
-	return (phy & 0x7fffffffffffffULL) * pagesize + ((uintptr_t) virt) % pagesize;
+// alignment of chunks handed out by the dma arena, the 82599 requires 128 byte aligned descriptor rings
+#define DMA_ARENA_ALIGNMENT 128
+
+// allocations smaller than a huge page are packed into a shared huge page instead of getting their own one
+// memory is never returned, the remainder of a page is lost once an allocation doesn't fit anymore
+// there is one arena per numa node, index 0 is used for allocations without a node preference
+struct dma_arena {
+	rte_spinlock_t lock;
+	struct dma_memory page;
+	size_t offset;
+};
+
+static struct dma_arena dma_arenas[MAX_NUMA_NODES + 1];
+
+static struct dma_memory allocate_huge_pages(size_t size, int numa_node) {
+	void* virt_addr = hugepage_map(size, numa_node);
+	return (struct dma_memory) {
+		.virt = virt_addr,
+		.phy = virt_to_phys(virt_addr)
+	};
 }
 
-static uint32_t huge_pg_id;
+// carve a 128 byte aligned chunk out of the current arena page, a chunk never crosses a huge page boundary
+// so it is physically contiguous
+static struct dma_memory dma_arena_allocate(size_t size, int numa_node) {
+	size = (size + DMA_ARENA_ALIGNMENT - 1) & ~((size_t) DMA_ARENA_ALIGNMENT - 1);
+	struct dma_arena* arena = &dma_arenas[numa_node + 1];
+	rte_spinlock_lock(&arena->lock);
+	if (!arena->page.virt || arena->offset + size > hugepage_size()) {
+		arena->page = allocate_huge_pages(hugepage_size(), numa_node);
+		arena->offset = 0;
+	}
+	struct dma_memory mem = {
+		.virt = ((uint8_t*) arena->page.virt) + arena->offset,
+		.phy = arena->page.phy + arena->offset
+	};
+	arena->offset += size;
+	rte_spinlock_unlock(&arena->lock);
+	return mem;
+}
 
 // allocate memory suitable for DMA access in huge pages
-// this requires hugetlbfs to be mounted at /mnt/huge
-// (not using anonymous hugepages because madvise might fail in subtle ways with some kernel configurations)
-// caution: very wasteful when allocating small chunks
-// this could be fixed by co-locating allocations on the same page until a request would be too large
+// small allocations (e.g., descriptor rings) share huge pages, everything is aligned to at least 128 bytes
+// larger allocations are rounded up to a multiple of the huge page size (see hugepage_size())
 struct dma_memory memory_allocate_dma(size_t size) {
-	// round up to multiples of 2 MB if necessary, this is the wasteful part
-	// when fixing this: make sure to align on 128 byte boundaries (82599 dma requirement)
-	if (size % (1 << 21)) {
-		size = ((size >> 21) + 1) << 21;
-	}
-	// C11 stdatomic.h requires a too recent gcc, we want to support gcc 4.8
-	uint32_t id = __sync_fetch_and_add(&huge_pg_id, 1);
-	char path[PATH_MAX];
-	snprintf(path, PATH_MAX, "/mnt/huge/ixy-%d-%d", getpid(), id);
-	// temporary file, will be deleted to prevent leaks of persistent pages
-	int fd = check_err(open(path, O_CREAT | O_RDWR, S_IRWXU), "open hugetlbfs file, check that /mnt/huge is mounted");
-	check_err(ftruncate(fd, (off_t) size), "allocate huge page memory, check hugetlbfs configuration");
-	void* virt_addr = (void*) check_err(mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_HUGETLB, fd, 0), "mmap hugepage");
-	// never swap out DMA memory
-	check_err(mlock(virt_addr, size), "disable swap for DMA memory");
-	// don't keep it around in the hugetlbfs
-	close(fd);
-	unlink(path);
-	// touch page so it is not lazily allocated and virt_to_phys() can resolve its address
-	volatile uint8_t temp = ((volatile uint8_t*)virt_addr)[0];
-	((volatile uint8_t*)virt_addr)[0] = temp;
+	return memory_allocate_dma_node(size, -1);
+}
+
+// same as memory_allocate_dma() but prefers memory on the given numa node, -1 for no preference
+// use the node of the device (ixy_device.numa_node) to avoid DMA across the socket interconnect
+struct dma_memory memory_allocate_dma_node(size_t size, int numa_node) {
+	if (numa_node < -1 || numa_node >= MAX_NUMA_NODES) {
+		error("numa node %d out of range, limit is %d", numa_node, MAX_NUMA_NODES - 1);
+	}
+	size_t page_size = hugepage_size();
+	if (size < page_size) {
+		return dma_arena_allocate(size, numa_node);
+	}
+	// round up to multiples of the page size if necessary
+	if (size % page_size) {
+		size = (size / page_size + 1) * page_size;
+	}
+	return allocate_huge_pages(size, numa_node);
+}
+
+// per-thread caches for thread-safe pools, avoids touching the shared ring for every packet
+// buffers move between a cache and the ring in bulk: the cache is refilled with cache_size buffers once it is empty
+// and flushed down to cache_size once it reaches the high watermark of 1.5 * cache_size
+struct mempool_cache {
+	uint32_t len;
+	uint32_t objs[MEMPOOL_CACHE_MAX_SIZE * 3 / 2];
+};
+
+static RTE_DEFINE_PER_LCORE(struct mempool_cache, mempool_caches[MEMPOOL_MAX_CACHES]);
+
+// caches are assigned to pools on creation, pools are never free'd so ids are never re-used
+static uint32_t next_cache_id;
+
+// all pools linked via next_pool, the list only grows
+static struct mempool* mempools;
+
+// automatic parallel initialization starts one thread per this many buffers (up to the number of cpus)
+#define MEMPOOL_INIT_ENTRIES_PER_THREAD 65536
+// number of buffers initialized at once when a MEMPOOL_F_LAZY_INIT pool runs empty
+#define MEMPOOL_LAZY_INIT_CHUNK 256
+
+// buffers are laid out contiguously if they fit into a single huge page or if the stride divides the page size
+// otherwise each page holds bufs_per_page buffers and the rest of the page stays unused, so that no buffer crosses a
+// page boundary: huge pages are not necessarily physically contiguous
+// offset of entry entry_id, the offset of entry num_entries is the size of the layout
+static inline size_t mempool_layout_offset(uint32_t entry_id, uint32_t stride, uint32_t bufs_per_page, size_t page_size) {
+	if (!bufs_per_page) {
+		return (size_t) entry_id * stride;
+	}
+	return (size_t) (entry_id / bufs_per_page) * page_size + (size_t) (entry_id % bufs_per_page) * stride;
+}
+
+static inline uint8_t* mempool_layout_addr(void* base_addr, uint32_t entry_id, uint32_t stride, uint32_t bufs_per_page, size_t page_size) {
+	return ((uint8_t*) base_addr) + mempool_layout_offset(entry_id, stride, bufs_per_page, page_size);
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+	while (b) {
+		uint32_t tmp = a % b;
+		a = b;
+		b = tmp;
+	}
+	return a;
+}
+
+// pads entries so that consecutive buffers start on different memory channels and ranks, this is what DPDK does
+// the channel and rank are selected by address bits just above the cache line offset (the exact mapping is
+// hardware-specific), a stride of 2048 bytes always hits the same one with the packet headers
+// picking a stride in cache lines that is coprime to channels * ranks spreads the headers over all of them
+static uint32_t mempool_stride(uint32_t entry_size, uint32_t mem_channels, uint32_t mem_ranks) {
+	uint32_t num_units = (mem_channels ? mem_channels : 1) * (mem_ranks ? mem_ranks : 1);
+	if (num_units <= 1) {
+		return entry_size;
+	}
+	uint32_t num_lines = (entry_size + 63) / 64;
+	while (gcd(num_lines, num_units) != 1) {
+		num_lines++;
+	}
+	return num_lines * 64;
+}
+
+#define MEMPOOL_PERSISTENT_MAGIC 0x4c4f4f5059584921ULL
+#define MEMPOOL_PERSISTENT_VERSION 2
+
+// stored in an extra entry after the buffers of a persistent pool, describes the layout of the pool
+// the magic is written last, a pool whose creation was interrupted is never reattached
+struct mempool_persistent_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t num_entries;
+	uint32_t entry_size;
+	uint32_t bufs_per_page;
+	// also detects a reboot or a recreated file: the pool would not be in the same physical memory
+	uintptr_t base_addr_phy;
+};
+
+// maps the persistent memory for params->name, the entry after the last buffer is used for the header
+// sets *attached if the memory contains a pool with the same layout, it can be reused as is in this case
+static struct dma_memory mempool_map_persistent(const struct mempool_params* params, uint32_t stride, uint32_t bufs_per_page, bool* attached) {
+	size_t page_size = hugepage_size();
+	size_t size = mempool_layout_offset(params->num_entries + 1, stride, bufs_per_page, page_size);
+	size = (size + page_size - 1) / page_size * page_size;
+	struct dma_memory mem;
+	mem.virt = hugepage_map_persistent(params->name, size, params->numa_node, attached);
+	mem.phy = virt_to_phys(mem.virt);
+	struct mempool_persistent_header* header = (struct mempool_persistent_header*)
+		mempool_layout_addr(mem.virt, params->num_entries, stride, bufs_per_page, page_size);
+	if (*attached && (header->magic != MEMPOOL_PERSISTENT_MAGIC
+		|| header->version != MEMPOOL_PERSISTENT_VERSION
+		|| header->num_entries != params->num_entries
+		|| header->entry_size != stride
+		|| header->bufs_per_page != bufs_per_page
+		|| header->base_addr_phy != mem.phy)) {
+		warn("persistent mempool %s does not match the requested pool, recreating it", params->name);
+		*attached = false;
+	}
+	if (*attached) {
+		info("reattached persistent mempool %s", params->name);
+		return mem;
+	}
+	header->magic = 0;
+	header->version = MEMPOOL_PERSISTENT_VERSION;
+	header->num_entries = params->num_entries;
+	header->entry_size = stride;
+	header->bufs_per_page = bufs_per_page;
+	header->base_addr_phy = mem.phy;
+	__sync_synchronize();
+	header->magic = MEMPOOL_PERSISTENT_MAGIC;
+	return mem;
+}
+
+// gets the memory for a pool from params->parent, buffers must not cross huge page boundaries (see
+// mempool_layout_offset()), so the block has to start on a page boundary if it spans more than one page
+static struct dma_memory mempool_allocate_parent(struct allocator* parent, size_t size) {
+	struct mem_blk blk = parent->allocate(parent, size);
+	if (!blk.ptr || blk.size < size) {
+		error("parent allocator %p failed to allocate %zu bytes for a mempool", parent, size);
+	}
+	size_t page_size = hugepage_size();
+	uintptr_t start = (uintptr_t) blk.ptr;
+	if (start % page_size && start / page_size != (start + size - 1) / page_size) {
+		error("memory %p from parent allocator %p crosses a huge page boundary but does not start on one", blk.ptr, parent);
+	}
 	return (struct dma_memory) {
-		.virt = virt_addr,
-		.phy = virt_to_phys(virt_addr)
+		.virt = blk.ptr,
+		.phy = virt_to_phys(blk.ptr)
 	};
 }
 
+// deletes the persistent memory of the pool created with this name, pools that currently use it stay valid
+void memory_delete_persistent_mempool(const char* name) {
+	hugepage_unlink_persistent(name);
+}
+
+// fills params with the defaults for a pool of num_entries buffers of entry_size bytes
+// entry_size can be 0 to use the default
+void mempool_params_init(struct mempool_params* params, uint32_t num_entries, uint32_t entry_size) {
+	params->num_entries = num_entries;
+	params->entry_size = entry_size;
+	params->flags = 0;
+	params->cache_size = 0;
+	params->numa_node = -1;
+	params->init_threads = 0;
+	params->name = NULL;
+	params->mem_channels = 0;
+	params->mem_ranks = 0;
+	params->headroom = MEMPOOL_DEFAULT_HEADROOM;
+	params->parent = NULL;
+}
+
 // allocate a memory pool from which DMA'able packet buffers can be allocated
-// this is currently not yet thread-safe, i.e., a pool can only be used by one thread,
+// this is not thread-safe, i.e., a pool can only be used by one thread,
 // this means a packet can only be sent/received by a single thread
+// use memory_allocate_mempool_ext() with MEMPOOL_F_MT for a pool that can be shared between threads
 // entry_size can be 0 to use the default
 struct mempool* memory_allocate_mempool(uint32_t num_entries, uint32_t entry_size) {
-	entry_size = entry_size ? entry_size : 2048;
-	struct mempool* mempool = (struct mempool*) malloc(sizeof(struct mempool) + num_entries * sizeof(uint32_t));
-	struct dma_memory mem = memory_allocate_dma(num_entries * entry_size);
-	mempool->num_entries = num_entries;
-	mempool->buf_size = entry_size;
-	mempool->base_addr_phy = mem.phy;
-	mempool->base_addr = mem.virt;
-	mempool->free_stack_top = num_entries;
-	for (uint32_t i = 0; i < num_entries; i++) {
-		mempool->free_stack[i] = i;
-		struct pkt_buf* buf = (struct pkt_buf*) (((uint8_t*) mempool->base_addr) + i * entry_size);
-		buf->buf_addr_phy = mempool->base_addr_phy + i * entry_size;
+	struct mempool_params params;
+	mempool_params_init(&params, num_entries, entry_size);
+	return memory_allocate_mempool_ext(&params);
+}
+
+// writes the headers of the buffers [first, last) and puts them on the free stack of single-threaded pools
+// only uses the page table of the pool, so it needs no syscalls and can run on several threads at once
+static void mempool_init_bufs(struct mempool* mempool, uint32_t first, uint32_t last) {
+	uint8_t* base_addr = (uint8_t*) mempool->base_addr;
+	uintptr_t first_page = ((uintptr_t) base_addr) >> mempool->page_shift;
+	uintptr_t page_mask = (((uintptr_t) 1) << mempool->page_shift) - 1;
+	for (uint32_t i = first; i < last; i++) {
+		struct pkt_buf* buf = (struct pkt_buf*) mempool_layout_addr(base_addr, i, mempool->buf_size, mempool->bufs_per_page, page_mask + 1);
+		uintptr_t virt = (uintptr_t) buf;
+		buf->buf_addr_phy = mempool->page_phys[(virt >> mempool->page_shift) - first_page] + (virt & page_mask);
 		buf->mempool_idx = i;
 		buf->mempool = mempool;
 		buf->size = 0;
+		buf->data_off = mempool->headroom;
+		buf->refcnt = 1;
+		buf->ext_addr = NULL;
+		if (!mempool->free_ring) {
+			mempool->free_stack[i] = i;
+		}
+	}
+}
+
+struct mempool_init_job {
+	struct mempool* mempool;
+	uint32_t first;
+	uint32_t last;
+};
+
+static void* mempool_init_thread(void* arg) {
+	struct mempool_init_job* job = (struct mempool_init_job*) arg;
+	mempool_init_bufs(job->mempool, job->first, job->last);
+	return NULL;
+}
+
+// splits initialization into equal slices, the calling thread handles the first one
+// this spawns threads, so it must happen before setup_seccomp()
+static void mempool_init_parallel(struct mempool* mempool, uint32_t num_threads) {
+	if (num_threads == 0) {
+		long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = mempool->num_entries / MEMPOOL_INIT_ENTRIES_PER_THREAD;
+		num_threads = num_threads < (uint32_t) num_cpus ? num_threads : (uint32_t) num_cpus;
+	}
+	num_threads = num_threads > mempool->num_entries ? mempool->num_entries : num_threads;
+	if (num_threads <= 1) {
+		mempool_init_bufs(mempool, 0, mempool->num_entries);
+		return;
+	}
+	struct mempool_init_job* jobs = (struct mempool_init_job*) malloc(num_threads * sizeof(struct mempool_init_job));
+	pthread_t* threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
+	uint32_t slice = mempool->num_entries / num_threads;
+	for (uint32_t i = 0; i < num_threads; i++) {
+		jobs[i].mempool = mempool;
+		jobs[i].first = i * slice;
+		jobs[i].last = i == num_threads - 1 ? mempool->num_entries : (i + 1) * slice;
+		if (i > 0 && pthread_create(&threads[i], NULL, mempool_init_thread, &jobs[i])) {
+			error("failed to start mempool init thread");
+		}
+	}
+	mempool_init_bufs(mempool, jobs[0].first, jobs[0].last);
+	for (uint32_t i = 1; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(jobs);
+}
+
+// initializes the next chunk of a MEMPOOL_F_LAZY_INIT pool and pushes it onto the free stack
+// returns false once all buffers of the pool are initialized
+static bool mempool_lazy_init_chunk(struct mempool* mempool) {
+	uint32_t first = mempool->lazy_init_next;
+	if (first >= mempool->num_entries) {
+		return false;
+	}
+	uint32_t last = mempool->num_entries - first < MEMPOOL_LAZY_INIT_CHUNK ? mempool->num_entries : first + MEMPOOL_LAZY_INIT_CHUNK;
+	mempool_init_bufs(mempool, first, last);
+	// at most the first buffers can be on the stack, so mempool_init_bufs() wrote the ids to an unused part of it
+	memmove(&mempool->free_stack[mempool->free_stack_top], &mempool->free_stack[first], (last - first) * sizeof(uint32_t));
+	mempool->free_stack_top += last - first;
+	mempool->lazy_init_next = last;
+	return true;
+}
+
+static struct mem_blk mempool_allocator_allocate(struct allocator* a, size_t size);
+static void mempool_allocator_deallocate(struct allocator* a, struct mem_blk* blk);
+static bool mempool_allocator_owns(struct allocator* a, const struct mem_blk* blk);
+
+// copied into every pool, the data of a buffer is cache line aligned
+static const struct allocator mempool_allocator_vfs = {
+	64,
+	mempool_allocator_allocate,
+	mempool_allocator_deallocate,
+	mempool_allocator_owns
+};
+
+struct mempool* memory_allocate_mempool_ext(const struct mempool_params* params) {
+	uint32_t num_entries = params->num_entries;
+	uint32_t entry_size = params->entry_size ? params->entry_size : 2048;
+	bool thread_safe = params->flags & MEMPOOL_F_MT;
+	bool lazy = params->flags & MEMPOOL_F_LAZY_INIT;
+	if (thread_safe && lazy) {
+		error("lazy initialization is only supported for single-threaded pools");
+	}
+	// the free stack is not used by thread-safe pools
+	size_t free_stack_size = thread_safe ? 0 : num_entries * sizeof(uint32_t);
+	size_t page_size = hugepage_size();
+	uint32_t stride = mempool_stride(entry_size, params->mem_channels, params->mem_ranks);
+	if (stride > page_size) {
+		error("entry size %u larger than the huge page size %zu", stride, page_size);
+	}
+	if (params->name && params->parent) {
+		error("persistent mempool %s can't use a parent allocator", params->name);
+	}
+	if (params->headroom > UINT16_MAX || offsetof(struct pkt_buf, data) + params->headroom >= entry_size) {
+		error("headroom %u does not fit into entries of %u bytes", params->headroom, entry_size);
+	}
+	// persistent pools use one more entry for their header
+	uint32_t num_slots = num_entries + (params->name ? 1 : 0);
+	uint32_t bufs_per_page = (size_t) num_slots * stride > page_size && page_size % stride ? (uint32_t) (page_size / stride) : 0;
+	struct mempool* mempool = (struct mempool*) malloc(sizeof(struct mempool) + free_stack_size);
+	struct dma_memory mem;
+	mempool->reattached = false;
+	memcpy(&mempool->vfs, &mempool_allocator_vfs, sizeof(mempool_allocator_vfs));
+	if (params->name) {
+		mem = mempool_map_persistent(params, stride, bufs_per_page, &mempool->reattached);
+	} else if (params->parent) {
+		mem = mempool_allocate_parent(params->parent, mempool_layout_offset(num_entries, stride, bufs_per_page, page_size));
+	} else {
+		mem = memory_allocate_dma_node(mempool_layout_offset(num_entries, stride, bufs_per_page, page_size), params->numa_node);
+	}
+	mempool->num_entries = num_entries;
+	mempool->buf_size = stride;
+	mempool->headroom = (uint16_t) params->headroom;
+	mempool->bufs_per_page = bufs_per_page;
+	mempool->base_addr_phy = mem.phy;
+	mempool->base_addr = mem.virt;
+	mempool->free_ring = thread_safe ? ring_create(num_entries) : NULL;
+	mempool->cache_id = -1;
+	mempool->cache_size = 0;
+	mempool->cache_flush_threshold = 0;
+	// resolve each huge page once, small pools live in a part of a single page
+	mempool->page_shift = (uint32_t) __builtin_ctzl(page_size);
+	uintptr_t first_page = ((uintptr_t) mem.virt) >> mempool->page_shift;
+	uintptr_t last_page = (((uintptr_t) mem.virt) + mempool_layout_offset(num_entries, stride, bufs_per_page, page_size) - 1) >> mempool->page_shift;
+	mempool->page_phys = (uintptr_t*) malloc((last_page - first_page + 1) * sizeof(uintptr_t));
+	for (uintptr_t page = first_page; page <= last_page; page++) {
+		mempool->page_phys[page - first_page] = virt_to_phys((void*) (page << mempool->page_shift));
+	}
+	if (lazy) {
+		mempool->lazy_init_next = 0;
+		mempool->free_stack_top = 0;
+	} else {
+		mempool->lazy_init_next = num_entries;
+		mempool->free_stack_top = thread_safe ? 0 : num_entries;
+		mempool_init_parallel(mempool, params->init_threads);
+	}
+	if (thread_safe) {
+		uint32_t entry_ids[256];
+		for (uint32_t i = 0; i < num_entries; i += 256) {
+			uint32_t num = num_entries - i < 256 ? num_entries - i : 256;
+			for (uint32_t j = 0; j < num; j++) {
+				entry_ids[j] = i + j;
+			}
+			ring_enqueue_bulk(mempool->free_ring, entry_ids, num);
+		}
+		if (params->cache_size) {
+			if (params->cache_size > MEMPOOL_CACHE_MAX_SIZE) {
+				error("cache size %u too large, limit is %u", params->cache_size, MEMPOOL_CACHE_MAX_SIZE);
+			}
+			uint32_t cache_id = __sync_fetch_and_add(&next_cache_id, 1);
+			if (cache_id < MEMPOOL_MAX_CACHES) {
+				mempool->cache_id = (int32_t) cache_id;
+				mempool->cache_size = params->cache_size;
+				mempool->cache_flush_threshold = params->cache_size + (params->cache_size + 1) / 2;
+			} else {
+				warn("all %d mempool caches in use, pool %p is not cached", MEMPOOL_MAX_CACHES, mempool);
+			}
+		}
+	} else if (params->cache_size) {
+		warn("caches are only supported for thread-safe pools, ignoring cache size for pool %p", mempool);
+	}
+	mempool->next_pool = __atomic_load_n(&mempools, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&mempools, &mempool->next_pool, mempool, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		// another pool was created concurrently, next_pool was updated to it
 	}
 	return mempool;
 }
 
-struct pkt_buf* pkt_buf_alloc(struct mempool* mempool) {
-	if (mempool->free_stack_top == 0) {
+static inline struct pkt_buf* mempool_get(struct mempool* mempool) {
+	uint32_t entry_id;
+	if (mempool->cache_id >= 0) {
+		struct mempool_cache* cache = &RTE_PER_LCORE(mempool_caches)[mempool->cache_id];
+		if (cache->len == 0) {
+			// low watermark: refill in a single bulk operation
+			cache->len = ring_dequeue_burst(mempool->free_ring, cache->objs, mempool->cache_size);
+			if (cache->len == 0) {
+				debug("memory pool %p is empty!", mempool);
+				return NULL;
+			}
+		}
+		entry_id = cache->objs[--cache->len];
+	} else if (mempool->free_ring) {
+		if (!ring_dequeue_burst(mempool->free_ring, &entry_id, 1)) {
+			debug("memory pool %p is empty!", mempool);
+			return NULL;
+		}
+	} else {
+		if (mempool->free_stack_top == 0 && !mempool_lazy_init_chunk(mempool)) {
+			debug("memory pool %p is empty!", mempool);
+			return NULL;
+		}
+		entry_id = mempool->free_stack[--mempool->free_stack_top];
+	}
+	return (struct pkt_buf*) mempool_layout_addr(mempool->base_addr, entry_id, mempool->buf_size, mempool->bufs_per_page, ((size_t) 1) << mempool->page_shift);
+}
+
+// translates buffer indices to buffers, written as a simple loop over contiguous arrays so that it is vectorized
+static inline void entries_to_bufs(const struct mempool* mempool, const uint32_t* entry_ids, struct pkt_buf* bufs[], uint32_t num_bufs) {
+	uint8_t* base_addr = (uint8_t*) mempool->base_addr;
+	uintptr_t buf_size = mempool->buf_size;
+	if (mempool->bufs_per_page) {
+		for (uint32_t i = 0; i < num_bufs; i++) {
+			bufs[i] = (struct pkt_buf*) mempool_layout_addr(base_addr, entry_ids[i], mempool->buf_size, mempool->bufs_per_page, ((size_t) 1) << mempool->page_shift);
+		}
+		return;
+	}
+	for (uint32_t i = 0; i < num_bufs; i++) {
+		bufs[i] = (struct pkt_buf*) (base_addr + entry_ids[i] * buf_size);
+	}
+}
+
+static inline uint32_t mempool_get_batch(struct mempool* mempool, struct pkt_buf* bufs[], uint32_t num_bufs) {
+	if (mempool->cache_id >= 0) {
+		struct mempool_cache* cache = &RTE_PER_LCORE(mempool_caches)[mempool->cache_id];
+		uint32_t num_allocated = 0;
+		while (num_allocated < num_bufs) {
+			if (cache->len == 0) {
+				cache->len = ring_dequeue_burst(mempool->free_ring, cache->objs, mempool->cache_size);
+				if (cache->len == 0) {
+					debug("memory pool %p is empty!", mempool);
+					break;
+				}
+			}
+			uint32_t num = num_bufs - num_allocated < cache->len ? num_bufs - num_allocated : cache->len;
+			cache->len -= num;
+			entries_to_bufs(mempool, &cache->objs[cache->len], bufs + num_allocated, num);
+			num_allocated += num;
+		}
+		return num_allocated;
+	} else if (mempool->free_ring) {
+		// dequeue in chunks, the ring can't hand out pointers directly
+		uint32_t entry_ids[64];
+		uint32_t num_allocated = 0;
+		while (num_allocated < num_bufs) {
+			uint32_t num = num_bufs - num_allocated < 64 ? num_bufs - num_allocated : 64;
+			num = ring_dequeue_burst(mempool->free_ring, entry_ids, num);
+			if (num == 0) {
+				debug("memory pool %p is empty!", mempool);
+				break;
+			}
+			entries_to_bufs(mempool, entry_ids, bufs + num_allocated, num);
+			num_allocated += num;
+		}
+		return num_allocated;
+	}
+	// a single bounds check for the whole batch, the top of the stack is translated in place
+	while (mempool->free_stack_top < num_bufs && mempool_lazy_init_chunk(mempool)) {
+		// lazy pool: initialize more buffers until the batch can be served
+	}
+	if (mempool->free_stack_top < num_bufs) {
 		debug("memory pool %p is empty!", mempool);
+		num_bufs = mempool->free_stack_top;
+	}
+	mempool->free_stack_top -= num_bufs;
+	entries_to_bufs(mempool, &mempool->free_stack[mempool->free_stack_top], bufs, num_bufs);
+	return num_bufs;
+}
+
+// to fall back to a second pool once a pool runs empty, compose them as allocators and use pkt_buf_alloc_from():
+// fallback_allocator_new(mempool_allocator(pool), mempool_allocator(secondary)), e.g., as rx_allocator of a device
+struct pkt_buf* pkt_buf_alloc(struct mempool* mempool) {
+	return mempool_get(mempool);
+}
+
+// allocates up to num_bufs buffers at once, much cheaper than calling pkt_buf_alloc() in a loop
+// returns the number of buffers placed in bufs, this is only less than num_bufs if the pool runs empty
+uint32_t pkt_buf_alloc_batch(struct mempool* mempool, struct pkt_buf* bufs[], uint32_t num_bufs) {
+	return mempool_get_batch(mempool, bufs, num_bufs);
+}
+
+static struct mem_blk mempool_allocator_allocate(struct allocator* a, size_t size) {
+	struct mempool* mempool = container_of(a, struct mempool, vfs);
+	struct pkt_buf* buf = size <= mempool->buf_size ? pkt_buf_alloc(mempool) : NULL;
+	if (!buf) {
+		return (struct mem_blk) {NULL, 0};
+	}
+	return (struct mem_blk) {buf, mempool->buf_size};
+}
+
+static void mempool_allocator_deallocate(struct allocator* a, struct mem_blk* blk) {
+	pkt_buf_free((struct pkt_buf*) blk->ptr);
+#if !defined(NDEBUG)
+	blk->ptr = NULL;
+	blk->size = 0;
+#endif
+}
+
+static bool mempool_allocator_owns(struct allocator* a, const struct mem_blk* blk) {
+	struct mempool* mempool = container_of(a, struct mempool, vfs);
+	size_t size = mempool_layout_offset(mempool->num_entries, mempool->buf_size, mempool->bufs_per_page, ((size_t) 1) << mempool->page_shift);
+	return (uint8_t*) blk->ptr >= (uint8_t*) mempool->base_addr && (uint8_t*) blk->ptr < (uint8_t*) mempool->base_addr + size;
+}
+
+// returns the pool behind a, NULL if a is not a pool created with memory_allocate_mempool_ext()
+struct mempool* mempool_from_allocator(struct allocator* a) {
+	if (a->allocate != mempool_allocator_allocate) {
+		return NULL;
+	}
+	return container_of(a, struct mempool, vfs);
+}
+
+// checks that ptr is the start of a buffer of one of the pools
+static bool is_pkt_buf(void* ptr) {
+	for (struct mempool* pool = __atomic_load_n(&mempools, __ATOMIC_ACQUIRE); pool; pool = pool->next_pool) {
+		struct mem_blk blk = {ptr, pool->buf_size};
+		if (mempool_allocator_owns(&pool->vfs, &blk)) {
+			// memory of the pool, so the header can be read; allocated buffers are always initialized
+			return ((struct pkt_buf*) ptr)->mempool == pool;
+		}
+	}
+	return false;
+}
+
+// allocates a buffer from a pool or a composition of pools, e.g., fallback_allocator_new() with two pools
+// every allocator that a can hand out memory from must be a pool (see mempool_allocator()), returns NULL if all are empty
+// plain pools are called directly, compositions pay for the indirect calls and a check of the returned block:
+// a composition that returns other memory (e.g., a stack_allocator leaf) is a bug and stops the program
+struct pkt_buf* pkt_buf_alloc_from(struct allocator* a) {
+	struct mempool* mempool = mempool_from_allocator(a);
+	if (mempool) {
+		return pkt_buf_alloc(mempool);
+	}
+	struct mem_blk blk = a->allocate(a, sizeof(struct pkt_buf));
+	if (blk.ptr && !is_pkt_buf(blk.ptr)) {
+		error("allocator %p returned %p which is not a buffer of a mempool, only pools can provide packet buffers", a, blk.ptr);
+	}
+	return (struct pkt_buf*) blk.ptr;
+}
+
+// batch version of pkt_buf_alloc_from(), returns the number of buffers placed in bufs
+uint32_t pkt_buf_alloc_batch_from(struct allocator* a, struct pkt_buf* bufs[], uint32_t num_bufs) {
+	struct mempool* mempool = mempool_from_allocator(a);
+	if (mempool) {
+		return pkt_buf_alloc_batch(mempool, bufs, num_bufs);
+	}
+	uint32_t num_allocated = 0;
+	while (num_allocated < num_bufs && (bufs[num_allocated] = pkt_buf_alloc_from(a))) {
+		num_allocated++;
+	}
+	return num_allocated;
+}
+
+// hands the external memory of buf back to its owner
+static void pkt_buf_detach_ext(struct pkt_buf* buf) {
+	struct ext_region* region = buf->ext_region;
+	void* addr = buf->ext_addr;
+	buf->ext_addr = NULL;
+	if (region->free_cb) {
+		region->free_cb(region, addr, buf->ext_opaque);
+	}
+}
+
+// returns num_bufs buffers that all belong to mempool
+static inline void mempool_put_batch(struct mempool* mempool, struct pkt_buf* bufs[], uint32_t num_bufs) {
+	// buffers in the pool are always empty with the default headroom and a single reference
+	// the header is in the cache anyways when freeing
+	for (uint32_t i = 0; i < num_bufs; i++) {
+		if (bufs[i]->ext_addr) {
+			pkt_buf_detach_ext(bufs[i]);
+		}
+		bufs[i]->size = 0;
+		bufs[i]->data_off = mempool->headroom;
+		bufs[i]->refcnt = 1;
+	}
+	if (mempool->cache_id >= 0) {
+		// buffers free'd on another thread than the one that allocated them simply end up in this thread's cache
+		struct mempool_cache* cache = &RTE_PER_LCORE(mempool_caches)[mempool->cache_id];
+		for (uint32_t i = 0; i < num_bufs; i++) {
+			cache->objs[cache->len++] = bufs[i]->mempool_idx;
+			if (cache->len >= mempool->cache_flush_threshold) {
+				// high watermark: return everything above cache_size to the shared ring
+				ring_enqueue_burst(mempool->free_ring, &cache->objs[mempool->cache_size], cache->len - mempool->cache_size);
+				cache->len = mempool->cache_size;
+			}
+		}
+	} else if (mempool->free_ring) {
+		uint32_t entry_ids[64];
+		for (uint32_t i = 0; i < num_bufs; i += 64) {
+			uint32_t num = num_bufs - i < 64 ? num_bufs - i : 64;
+			for (uint32_t j = 0; j < num; j++) {
+				entry_ids[j] = bufs[i + j]->mempool_idx;
+			}
+			// can't fail, the ring is large enough for all buffers of the pool
+			ring_enqueue_burst(mempool->free_ring, entry_ids, num);
+		}
+	} else {
+		uint32_t* free_stack = &mempool->free_stack[mempool->free_stack_top];
+		for (uint32_t i = 0; i < num_bufs; i++) {
+			free_stack[i] = bufs[i]->mempool_idx;
+		}
+		mempool->free_stack_top += num_bufs;
+	}
+}
+
+// drops one reference, returns true if it was the last one and the buffer has to go back to its pool
+static inline bool pkt_buf_release(struct pkt_buf* buf) {
+	// common case: the caller is the only user, nobody else can modify the count concurrently
+	if (__atomic_load_n(&buf->refcnt, __ATOMIC_RELAXED) == 1) {
+		return true;
+	}
+	return __atomic_sub_fetch(&buf->refcnt, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+// frees num_bufs buffers at once, the buffers may belong to different mempools
+void pkt_buf_free_batch(struct pkt_buf* bufs[], uint32_t num_bufs) {
+	// a batch usually comes from a single pool, so collect runs of released buffers with the same pool
+	struct pkt_buf* released[64];
+	uint32_t num_released = 0;
+	for (uint32_t i = 0; i < num_bufs; i++) {
+		struct pkt_buf* buf = bufs[i];
+		if (!pkt_buf_release(buf)) {
+			continue;
+		}
+		if (num_released == 64 || (num_released && released[0]->mempool != buf->mempool)) {
+			mempool_put_batch(released[0]->mempool, released, num_released);
+			num_released = 0;
+		}
+		released[num_released++] = buf;
+	}
+	if (num_released) {
+		mempool_put_batch(released[0]->mempool, released, num_released);
+	}
+}
+
+// makes memory obtained from a dma allocator (e.g., dma_allocator_t) available for pkt_buf_attach_ext()
+// the physical addresses are resolved here, so this must be called before setup_seccomp()
+// free_cb can be NULL if the application doesn't need to know when the nic is done with the memory
+struct ext_region* memory_register_ext_region(const struct mem_blk* blk, void (*free_cb)(struct ext_region* region, void* addr, void* opaque)) {
+	size_t page_size = hugepage_size();
+	if (((uintptr_t) blk->ptr) % page_size || !blk->size) {
+		error("external region %p must start at a huge page boundary", blk->ptr);
+	}
+	struct ext_region* region = (struct ext_region*) malloc(sizeof(struct ext_region));
+	region->base_addr = blk->ptr;
+	region->size = blk->size;
+	region->free_cb = free_cb;
+	region->page_shift = (uint32_t) __builtin_ctzl(page_size);
+	size_t num_pages = (blk->size + page_size - 1) / page_size;
+	region->page_phys = (uintptr_t*) malloc(num_pages * sizeof(uintptr_t));
+	for (size_t i = 0; i < num_pages; i++) {
+		region->page_phys[i] = virt_to_phys(((uint8_t*) blk->ptr) + i * page_size);
+	}
+	return region;
+}
+
+// creates a packet for len bytes at addr in region without copying them, the packet can be transmitted as usual
+// only the header is taken from mempool, a pool with small entries and no headroom is sufficient
+// the free callback of the region gets addr and opaque once the last reference to the packet is free'd
+// returns NULL if mempool is empty
+struct pkt_buf* pkt_buf_attach_ext(struct mempool* mempool, struct ext_region* region, void* addr, uint32_t len, void* opaque) {
+	uintptr_t offset = (uintptr_t) addr - (uintptr_t) region->base_addr;
+	if ((uintptr_t) addr < (uintptr_t) region->base_addr || offset + len > region->size) {
+		error("external buffer %p is not in region %p", addr, region->base_addr);
+	}
+	// the nic gets a single physical address for the packet
+	if (len && offset >> region->page_shift != (offset + len - 1) >> region->page_shift) {
+		error("external buffer %p crosses a huge page boundary", addr);
+	}
+	struct pkt_buf* buf = pkt_buf_alloc(mempool);
+	if (!buf) {
 		return NULL;
 	}
-	uint32_t entry_id = mempool->free_stack[--mempool->free_stack_top];
-	return (struct pkt_buf*) (((uint8_t*) mempool->base_addr) + entry_id * mempool->buf_size);
+	buf->ext_addr = (uint8_t*) addr;
+	buf->ext_addr_phy = region->page_phys[offset >> region->page_shift] + (offset & ((((uintptr_t) 1) << region->page_shift) - 1));
+	buf->ext_region = region;
+	buf->ext_opaque = opaque;
+	buf->data_off = 0;
+	buf->size = len;
+	return buf;
+}
+
+// adds a reference to buf and returns it, e.g., to transmit the same packet on several ports or queues
+// every reference has to be free'd (transmitting a packet frees it), the last one returns the buffer to its pool
+// all references share data and metadata: a packet with more than one reference must not be modified
+struct pkt_buf* pkt_buf_clone(struct pkt_buf* buf) {
+	__atomic_add_fetch(&buf->refcnt, 1, __ATOMIC_RELAXED);
+	return buf;
 }
 
 void pkt_buf_free(struct pkt_buf* buf) {
-	struct mempool* mempool = buf->mempool;
-	mempool->free_stack[mempool->free_stack_top++] = buf->mempool_idx;
+	if (!pkt_buf_release(buf)) {
+		return;
+	}
+	// a batch of one, the loops in there are cheap for a single buffer
+	mempool_put_batch(buf->mempool, &buf, 1);
 }
 
+// returns all buffers cached by the calling thread to the shared pool
+// call this before a thread that used a cached pool exits, its cached buffers are lost otherwise
+void mempool_cache_flush(struct mempool* mempool) {
+	if (mempool->cache_id < 0) {
+		return;
+	}
+	struct mempool_cache* cache = &RTE_PER_LCORE(mempool_caches)[mempool->cache_id];
+	ring_enqueue_burst(mempool->free_ring, cache->objs, cache->len);
+	cache->len = 0;
+}
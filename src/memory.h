@@ -1,9 +1,13 @@
 #ifndef IXY_MEMORY_H
 #define IXY_MEMORY_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <unistd.h>
 
+#include "allocator/allocator.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -13,21 +17,111 @@ struct pkt_buf {
 	uintptr_t buf_addr_phy;
 	struct mempool* mempool;
 	uint32_t mempool_idx;
+	// length of the packet
 	uint32_t size;
+	// offset of the first byte of the packet in data, the space before it is the headroom
+	// use pkt_buf_data() to access the packet, the driver passes pkt_buf_data_phy() to the nic
+	uint16_t data_off;
+	// number of users of the buffer, it only goes back to the pool once the last one frees it, see pkt_buf_clone()
+	// 1 for buffers in the pool, always modified with atomic operations if it is larger than 1
+	uint16_t refcnt;
+	// set for buffers attached to external memory with pkt_buf_attach_ext(), the packet is at ext_addr + data_off
+	// instead of in data; ext_region and ext_opaque are passed to the free callback of the region
+	uint8_t* ext_addr;
+	uintptr_t ext_addr_phy;
+	struct ext_region* ext_region;
+	void* ext_opaque;
 	uint8_t data[] __attribute__((aligned(64)));
 };
 
+// application-owned DMA memory that packets can be transmitted from without copying them into a pool
+// see memory_register_ext_region()
+struct ext_region {
+	void* base_addr;
+	size_t size;
+	// physical address of every huge page of the region
+	uintptr_t* page_phys;
+	uint32_t page_shift;
+	// called once the last reference to an attached buffer is free'd, e.g., after the nic transmitted it
+	void (*free_cb)(struct ext_region* region, void* addr, void* opaque);
+};
+
 struct mempool {
+	// the pool as a struct allocator, allows composing pools with the allocators in src/allocator
+	// see mempool_allocator(), the pkt_buf_* functions call the pool directly and never go through it
+	struct allocator vfs;
 	void* base_addr;
 	uintptr_t base_addr_phy;
+	// distance between two buffers, larger than the requested entry size if the pool is padded for memory channels
 	uint32_t buf_size;
+	// initial data_off of all buffers, restored when a buffer is returned to the pool
+	uint16_t headroom;
 	uint32_t num_entries;
-	// memory is managed via a simple stack
-	// replacing this with a lock-free queue (or stack) makes this thread-safe
+	// 0 if the buffers are contiguous, otherwise every huge page holds this many buffers (no buffer crosses a page)
+	uint32_t bufs_per_page;
+	// thread-safe pools keep their free buffers in a lock-free ring, NULL for single-threaded pools
+	struct ring* free_ring;
+	// per-thread cache in front of free_ring, -1 if the pool has no cache
+	int32_t cache_id;
+	uint32_t cache_size;
+	// high watermark: a thread's cache is flushed down to cache_size once it holds this many buffers
+	uint32_t cache_flush_threshold;
+	// physical address of every huge page of the pool, buffer addresses are translated without syscalls
+	uintptr_t* page_phys;
+	uint32_t page_shift;
+	// buffers with an index >= lazy_init_next have not been initialized yet, see MEMPOOL_F_LAZY_INIT
+	uint32_t lazy_init_next;
+	// persistent pool that was left behind by a previous process, the content of the buffers is preserved
+	bool reattached;
+	// next pool in the list of all pools, see pkt_buf_alloc_from()
+	struct mempool* next_pool;
+	// single-threaded pools are managed via a simple stack, this is faster than the ring if there is only one thread
 	uint32_t free_stack_top;
 	uint32_t free_stack[];
 };
 
+// pool can be used from multiple threads, e.g., buffers can be allocated on one core and free'd on another
+#define MEMPOOL_F_MT 0x1
+// buffer headers are written in chunks when the free stack runs empty instead of on creation, not for MEMPOOL_F_MT pools
+#define MEMPOOL_F_LAZY_INIT 0x2
+
+// space in front of received packets, allows prepending headers (e.g., for tunnels or vlan tags) without copying
+#define MEMPOOL_DEFAULT_HEADROOM 128
+
+// upper limit for mempool_params.cache_size
+#define MEMPOOL_CACHE_MAX_SIZE 512
+// number of thread-safe pools that can have a per-thread cache
+#define MEMPOOL_MAX_CACHES 16
+
+struct mempool_params {
+	uint32_t num_entries;
+	// 0 to use the default
+	uint32_t entry_size;
+	// MEMPOOL_F_* flags
+	uint32_t flags;
+	// number of buffers each thread keeps locally, only for MEMPOOL_F_MT pools, 0 to disable
+	uint32_t cache_size;
+	// numa node to place the buffers on, usually the node of the nic; -1 for no preference
+	int numa_node;
+	// number of threads writing the buffer headers on creation, 0 picks a number based on pool size and cpu count
+	uint32_t init_threads;
+	// name for a persistent pool, NULL for a regular pool
+	// the memory of a persistent pool is kept in hugetlbfs when the process exits and is reattached by the next
+	// process that creates a pool with the same name and layout, see memory_delete_persistent_mempool()
+	// only one pool at a time can use a name, creating a second one (in any process) stops with an error
+	const char* name;
+	// number of memory channels and ranks per channel of the system, 0 if unknown
+	// buffers are padded so that consecutive buffers start on different channels and ranks
+	uint32_t mem_channels;
+	uint32_t mem_ranks;
+	// bytes reserved in front of the packet data of each buffer, MEMPOOL_DEFAULT_HEADROOM by default
+	uint32_t headroom;
+	// allocator providing the memory of the buffers, NULL for the built-in dma memory on numa_node
+	// must return huge page memory (e.g., dma_allocator_new_node()) that starts on a page boundary unless the pool
+	// fits into a single page, it is called once when the pool is created; not supported for persistent pools
+	struct allocator* parent;
+};
+
 struct dma_memory {
 	void* virt;
 	uintptr_t phy;
@@ -35,10 +129,105 @@ struct dma_memory {
 
 
 struct dma_memory memory_allocate_dma(size_t size);
+struct dma_memory memory_allocate_dma_node(size_t size, int numa_node);
 
+void mempool_params_init(struct mempool_params* params, uint32_t num_entries, uint32_t entry_size);
 struct mempool* memory_allocate_mempool(uint32_t num_entries, uint32_t entry_size);
+struct mempool* memory_allocate_mempool_ext(const struct mempool_params* params);
+void memory_delete_persistent_mempool(const char* name);
 struct pkt_buf* pkt_buf_alloc(struct mempool* mempool);
+uint32_t pkt_buf_alloc_batch(struct mempool* mempool, struct pkt_buf* bufs[], uint32_t num_bufs);
 void pkt_buf_free(struct pkt_buf* buf);
+void pkt_buf_free_batch(struct pkt_buf* bufs[], uint32_t num_bufs);
+struct pkt_buf* pkt_buf_clone(struct pkt_buf* buf);
+struct ext_region* memory_register_ext_region(const struct mem_blk* blk, void (*free_cb)(struct ext_region* region, void* addr, void* opaque));
+struct pkt_buf* pkt_buf_attach_ext(struct mempool* mempool, struct ext_region* region, void* addr, uint32_t len, void* opaque);
+void mempool_cache_flush(struct mempool* mempool);
+struct mempool* mempool_from_allocator(struct allocator* a);
+struct pkt_buf* pkt_buf_alloc_from(struct allocator* a);
+uint32_t pkt_buf_alloc_batch_from(struct allocator* a, struct pkt_buf* bufs[], uint32_t num_bufs);
+
+// the pool as a struct allocator, blocks are whole buffers (struct pkt_buf) of mempool->buf_size bytes
+// deallocating a block is the same as pkt_buf_free(), buffers allocated via the pool can be free'd either way
+static inline struct allocator* mempool_allocator(struct mempool* mempool) {
+	return &mempool->vfs;
+}
+
+// first byte of the packet, use this instead of buf->data: the packet of an external buffer is at ext_addr
+static inline uint8_t* pkt_buf_data(const struct pkt_buf* buf) {
+	return (buf->ext_addr ? buf->ext_addr : (uint8_t*) buf->data) + buf->data_off;
+}
+
+// physical address of the first byte of the packet, this is what the nic reads from or writes to
+static inline uintptr_t pkt_buf_data_phy(const struct pkt_buf* buf) {
+	if (buf->ext_addr) {
+		return buf->ext_addr_phy + buf->data_off;
+	}
+	return buf->buf_addr_phy + offsetof(struct pkt_buf, data) + buf->data_off;
+}
+
+static inline uint32_t pkt_buf_headroom(const struct pkt_buf* buf) {
+	return buf->data_off;
+}
+
+// space from the start of the packet until the end of the buffer, i.e., the largest packet with the current headroom
+// independent of the packet currently in the buffer; 0 for external buffers, they can't grow
+static inline uint32_t pkt_buf_capacity(const struct pkt_buf* buf) {
+	if (buf->ext_addr) {
+		return 0;
+	}
+	return buf->mempool->buf_size - (uint32_t) offsetof(struct pkt_buf, data) - buf->data_off;
+}
+
+// space after the end of the packet until the end of the buffer, external buffers have no tailroom
+static inline uint32_t pkt_buf_tailroom(const struct pkt_buf* buf) {
+	if (buf->ext_addr) {
+		return 0;
+	}
+	return pkt_buf_capacity(buf) - buf->size;
+}
+
+// grows the packet by len bytes at the front, e.g., to add an encapsulation header
+// returns the new start of the packet or NULL if there is not enough headroom, the packet is unchanged in this case
+static inline uint8_t* pkt_buf_prepend(struct pkt_buf* buf, uint16_t len) {
+	if (len > buf->data_off) {
+		return NULL;
+	}
+	buf->data_off -= len;
+	buf->size += len;
+	return pkt_buf_data(buf);
+}
+
+// removes len bytes from the front of the packet, e.g., to strip a header
+// returns the new start of the packet or NULL if the packet is shorter than len
+static inline uint8_t* pkt_buf_adj(struct pkt_buf* buf, uint16_t len) {
+	if (len > buf->size) {
+		return NULL;
+	}
+	buf->data_off += len;
+	buf->size -= len;
+	return pkt_buf_data(buf);
+}
+
+// grows the packet by len bytes at the end
+// returns a pointer to the first appended byte or NULL if there is not enough tailroom
+static inline uint8_t* pkt_buf_append(struct pkt_buf* buf, uint16_t len) {
+	if (len > pkt_buf_tailroom(buf)) {
+		return NULL;
+	}
+	uint8_t* tail = pkt_buf_data(buf) + buf->size;
+	buf->size += len;
+	return tail;
+}
+
+// removes len bytes from the end of the packet, returns false if the packet is shorter than len
+static inline bool pkt_buf_trim(struct pkt_buf* buf, uint16_t len) {
+	if (len > buf->size) {
+		return false;
+	}
+	buf->size -= len;
+	return true;
+}
 
 #ifdef __cplusplus
 }
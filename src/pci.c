@@ -36,10 +36,27 @@ static void enable_dma(const char* pci_addr) {
 	assert(write(fd, &dma, 2) == 2);
 }
 
+// numa node the device is attached to, -1 if unknown (e.g., single-socket systems)
+int pci_numa_node(const char* pci_addr) {
+	char path[PATH_MAX];
+	snprintf(path, PATH_MAX, "/sys/bus/pci/devices/%s/numa_node", pci_addr);
+	FILE* file = fopen(path, "r");
+	if (!file) {
+		debug("no numa information for device %s", pci_addr);
+		return -1;
+	}
+	int node = -1;
+	if (fscanf(file, "%d", &node) != 1) {
+		node = -1;
+	}
+	fclose(file);
+	return node;
+}
+
 uint8_t* pci_map_resource(const char* pci_addr) {
 	char path[PATH_MAX];
 	snprintf(path, PATH_MAX, "/sys/bus/pci/devices/%s/resource0", pci_addr);
-	info("Mapping PCI resource at %s", path);
+	info("Mapping PCI resource at %s (numa node %d)", path, pci_numa_node(pci_addr));
 	remove_driver(pci_addr);
 	enable_dma(pci_addr);
 	int fd = check_err(open(path, O_RDWR), "open pci resource");
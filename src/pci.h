@@ -8,6 +8,7 @@ extern "C" {
 #endif
 
 uint8_t* pci_map_resource(const char* bus_id);
+int pci_numa_node(const char* bus_id);
 
 #ifdef __cplusplus
 }
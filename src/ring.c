@@ -0,0 +1,26 @@
+#include "ring.h"
+#include "log.h"
+
+// creates a ring that can hold at least count entries, the size is rounded up to a power of 2
+struct ring* ring_create(uint32_t count) {
+	if (count == 0 || count > (1u << 31)) {
+		error("invalid ring size %u", count);
+	}
+	uint32_t size = 1;
+	while (size < count) {
+		size <<= 1;
+	}
+	struct ring* ring;
+	if (posix_memalign((void**) &ring, 64, sizeof(struct ring) + size * sizeof(uint32_t))) {
+		error("failed to allocate ring of size %u", size);
+	}
+	ring->size = size;
+	ring->mask = size - 1;
+	ring->prod.head = ring->prod.tail = 0;
+	ring->cons.head = ring->cons.tail = 0;
+	return ring;
+}
+
+void ring_free(struct ring* ring) {
+	free(ring);
+}
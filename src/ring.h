@@ -0,0 +1,111 @@
+#ifndef IXY_RING_H
+#define IXY_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <emmintrin.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// lock-free multi-producer/multi-consumer ring of 32 bit values (e.g., mempool indices)
+// the algorithm is the one used by DPDK's rte_ring: producers and consumers each reserve a range of slots by
+// moving their head with a CAS, copy their entries, and then publish the range by moving their tail in order
+// head and tail are free-running counters, the slot of a counter is (counter & mask)
+// C11 stdatomic.h requires a too recent gcc, the __atomic builtins are available since gcc 4.7
+struct ring_headtail {
+	uint32_t head;
+	uint32_t tail;
+};
+
+struct ring {
+	uint32_t size;
+	uint32_t mask;
+	// producer and consumer state on separate cache lines to prevent false sharing
+	struct ring_headtail prod __attribute__((aligned(64)));
+	struct ring_headtail cons __attribute__((aligned(64)));
+	uint32_t entries[] __attribute__((aligned(64)));
+};
+
+struct ring* ring_create(uint32_t count);
+void ring_free(struct ring* ring);
+
+// wait until earlier reservations are published, then publish ours
+static inline void ring_update_tail(struct ring_headtail* ht, uint32_t old_val, uint32_t new_val) {
+	while (__atomic_load_n(&ht->tail, __ATOMIC_RELAXED) != old_val) {
+		_mm_pause();
+	}
+	__atomic_store_n(&ht->tail, new_val, __ATOMIC_RELEASE);
+}
+
+// enqueue n entries, all or nothing if fixed is set, as many as possible otherwise
+// returns the number of entries enqueued
+static inline uint32_t ring_do_enqueue(struct ring* ring, const uint32_t* objs, uint32_t n, bool fixed) {
+	uint32_t old_head, new_head;
+	do {
+		old_head = __atomic_load_n(&ring->prod.head, __ATOMIC_RELAXED);
+		uint32_t free_entries = ring->size + __atomic_load_n(&ring->cons.tail, __ATOMIC_ACQUIRE) - old_head;
+		if (n > free_entries) {
+			if (fixed || !free_entries) {
+				return 0;
+			}
+			n = free_entries;
+		}
+		new_head = old_head + n;
+	} while (!__atomic_compare_exchange_n(&ring->prod.head, &old_head, new_head, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	for (uint32_t i = 0; i < n; i++) {
+		ring->entries[(old_head + i) & ring->mask] = objs[i];
+	}
+	ring_update_tail(&ring->prod, old_head, new_head);
+	return n;
+}
+
+// dequeue n entries, all or nothing if fixed is set, as many as possible otherwise
+// returns the number of entries dequeued
+static inline uint32_t ring_do_dequeue(struct ring* ring, uint32_t* objs, uint32_t n, bool fixed) {
+	uint32_t old_head, new_head;
+	do {
+		old_head = __atomic_load_n(&ring->cons.head, __ATOMIC_RELAXED);
+		uint32_t entries = __atomic_load_n(&ring->prod.tail, __ATOMIC_ACQUIRE) - old_head;
+		if (n > entries) {
+			if (fixed || !entries) {
+				return 0;
+			}
+			n = entries;
+		}
+		new_head = old_head + n;
+	} while (!__atomic_compare_exchange_n(&ring->cons.head, &old_head, new_head, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	for (uint32_t i = 0; i < n; i++) {
+		objs[i] = ring->entries[(old_head + i) & ring->mask];
+	}
+	ring_update_tail(&ring->cons, old_head, new_head);
+	return n;
+}
+
+static inline uint32_t ring_enqueue_bulk(struct ring* ring, const uint32_t* objs, uint32_t n) {
+	return ring_do_enqueue(ring, objs, n, true);
+}
+
+static inline uint32_t ring_enqueue_burst(struct ring* ring, const uint32_t* objs, uint32_t n) {
+	return ring_do_enqueue(ring, objs, n, false);
+}
+
+static inline uint32_t ring_dequeue_bulk(struct ring* ring, uint32_t* objs, uint32_t n) {
+	return ring_do_dequeue(ring, objs, n, true);
+}
+
+static inline uint32_t ring_dequeue_burst(struct ring* ring, uint32_t* objs, uint32_t n) {
+	return ring_do_dequeue(ring, objs, n, false);
+}
+
+// snapshot of the number of entries, may be outdated by the time it is returned
+static inline uint32_t ring_count(const struct ring* ring) {
+	return __atomic_load_n(&ring->prod.tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->cons.tail, __ATOMIC_ACQUIRE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //IXY_RING_H
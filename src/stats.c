@@ -6,6 +6,9 @@
 void print_stats(struct device_stats* stats) {
 	printf("[%s] RX: %zu bytes %zu packets\n", stats->device ? stats->device->pci_addr : "???", stats->rx_bytes, stats->rx_pkts);
 	printf("[%s] TX: %zu bytes %zu packets\n", stats->device ? stats->device->pci_addr : "???", stats->tx_bytes, stats->tx_pkts);
+	if (stats->rx_nombuf) {
+		printf("[%s] RX: %zu packets dropped, mempool empty\n", stats->device ? stats->device->pci_addr : "???", stats->rx_nombuf);
+	}
 }
 
 static double diff_mpps(uint64_t pkts_new, uint64_t pkts_old, uint64_t nanos) {
@@ -28,6 +31,11 @@ void print_stats_diff(struct device_stats* stats_new, struct device_stats* stats
 	       diff_mbit(stats_new->tx_bytes, stats_old->tx_bytes, stats_new->tx_pkts, stats_old->tx_pkts, nanos),
 	       diff_mpps(stats_new->tx_pkts, stats_old->tx_pkts, nanos)
 	);
+	if (stats_new->rx_nombuf != stats_old->rx_nombuf) {
+		printf("[%s] RX: %.2f Mpps dropped, mempool empty\n", stats_new->device ? stats_new->device->pci_addr : "???",
+			diff_mpps(stats_new->rx_nombuf, stats_old->rx_nombuf, nanos)
+		);
+	}
 }
 
 
@@ -46,6 +54,7 @@ void stats_init(struct device_stats* stats, struct ixy_device* dev) {
 	stats->tx_pkts = 0;
 	stats->rx_bytes = 0;
 	stats->tx_bytes = 0;
+	stats->rx_nombuf = 0;
 	stats->device = dev;
 	if (dev) {
 		ixgbe_read_stats(dev, NULL);
@@ -35,11 +35,15 @@ ixy::device_stats::device_stats(const char* pci_addr)
           rx_pkts(0),
           tx_pkts(0),
           rx_bytes(0),
-          tx_bytes(0) { }
+          tx_bytes(0),
+          rx_nombuf(0) { }
 
 void ixy::device_stats::print_stats() {
     printf("[%s] RX: %zu bytes %zu packets\n", pci_addr, rx_bytes, rx_pkts);
     printf("[%s] TX: %zu bytes %zu packets\n", pci_addr, tx_bytes, tx_pkts);
+    if (rx_nombuf) {
+        printf("[%s] RX: %zu packets dropped, mempool empty\n", pci_addr, rx_nombuf);
+    }
 }
 
 void ixy::device_stats::print_stats_diff(ixy::device_stats* stats_old, uint64_t nanos_passed) {
@@ -51,4 +55,9 @@ void ixy::device_stats::print_stats_diff(ixy::device_stats* stats_old, uint64_t
            diff_mbit(tx_bytes, stats_old->tx_bytes, tx_pkts, stats_old->tx_pkts, nanos_passed),
            diff_mpps(tx_pkts, stats_old->tx_pkts, nanos_passed)
     );
+    if (rx_nombuf != stats_old->rx_nombuf) {
+        printf("[%s] RX: %.2f Mpps dropped, mempool empty\n", pci_addr,
+               diff_mpps(rx_nombuf, stats_old->rx_nombuf, nanos_passed)
+        );
+    }
 }
@@ -12,6 +12,8 @@ struct device_stats {
 	size_t tx_pkts;
 	size_t rx_bytes;
 	size_t tx_bytes;
+	// packets dropped by the driver because the mempool was empty
+	size_t rx_nombuf;
 };
 
 
@@ -13,6 +13,8 @@ namespace ixy {
         size_t tx_pkts;
         size_t rx_bytes;
         size_t tx_bytes;
+        // packets dropped by the driver because the mempool was empty
+        size_t rx_nombuf;
 
         explicit device_stats(const char* pci_addr = "???");
 
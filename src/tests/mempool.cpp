@@ -0,0 +1,401 @@
+#include "memory.h"
+#include "hugepage.h"
+#include "exception_path.h"
+
+#include <cstdio>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cassert>
+
+// Same approach as the allocator tests, to be replaced by real test framework
+// pools need huge pages with physical addresses: this runs as root with hugetlbfs mounted and is skipped otherwise
+
+static void count_free_cb(struct ext_region*, void*, void* opaque) {
+    (*(int*) opaque)++;
+}
+
+// the headroom and tailroom helpers keep the packet inside the buffer, a free'd buffer gets its headroom back
+void headroom_test() {
+    struct mempool_params params;
+    mempool_params_init(&params, 4, 2048);
+    params.headroom = 64;
+    auto pool = memory_allocate_mempool_ext(&params);
+    auto buf = pkt_buf_alloc(pool);
+    assert(buf && buf->size == 0 && pkt_buf_headroom(buf) == 64);
+    uint32_t room = pool->buf_size - (uint32_t) offsetof(struct pkt_buf, data) - 64;
+    assert(pkt_buf_tailroom(buf) == room);
+    auto start = pkt_buf_data(buf);
+    assert(start == buf->data + 64 && pkt_buf_data_phy(buf) == buf->buf_addr_phy + offsetof(struct pkt_buf, data) + 64);
+    auto tail = pkt_buf_append(buf, 100);
+    assert(tail == start && buf->size == 100 && pkt_buf_tailroom(buf) == room - 100);
+    tail = pkt_buf_append(buf, (uint16_t) (room - 99));
+    assert(!tail && buf->size == 100);
+    // encapsulation header
+    auto data = pkt_buf_prepend(buf, 14);
+    assert(data == start - 14 && buf->size == 114 && pkt_buf_headroom(buf) == 50);
+    data = pkt_buf_prepend(buf, 51);
+    assert(!data && pkt_buf_headroom(buf) == 50);
+    data = pkt_buf_adj(buf, 14);
+    assert(data == start && buf->size == 100);
+    data = pkt_buf_adj(buf, 101);
+    assert(!data && buf->size == 100);
+    (void) start;
+    (void) tail;
+    (void) data;
+    bool trimmed = pkt_buf_trim(buf, 40);
+    assert(trimmed && buf->size == 60 && pkt_buf_tailroom(buf) == room - 60);
+    trimmed = pkt_buf_trim(buf, 61);
+    assert(!trimmed && buf->size == 60);
+    (void) trimmed;
+    pkt_buf_free(buf);
+    // the packet is gone as well, the whole buffer can be appended to again
+    buf = pkt_buf_alloc(pool);
+    assert(buf->size == 0 && pkt_buf_headroom(buf) == 64 && pkt_buf_tailroom(buf) == room);
+    tail = pkt_buf_append(buf, 10);
+    assert(tail == buf->data + 64);
+    pkt_buf_free(buf);
+}
+
+// a buffer that carried a large packet comes back empty, no matter how it was free'd
+void reuse_test() {
+    struct mempool_params params;
+    mempool_params_init(&params, 4, 2048);
+    params.flags = MEMPOOL_F_MT;
+    params.cache_size = 2;
+    struct mempool* pools[] = {memory_allocate_mempool(4, 2048), memory_allocate_mempool_ext(&params)};
+    for (auto pool : pools) {
+        uint32_t room = pool->buf_size - (uint32_t) offsetof(struct pkt_buf, data) - MEMPOOL_DEFAULT_HEADROOM;
+        struct pkt_buf* bufs[4];
+        uint32_t num = pkt_buf_alloc_batch(pool, bufs, 4);
+        assert(num == 4);
+        for (auto buf : bufs)
+            pkt_buf_append(buf, 1500);
+        pkt_buf_free(bufs[0]);
+        pkt_buf_free_batch(bufs + 1, 3);
+        num = pkt_buf_alloc_batch(pool, bufs, 4);
+        assert(num == 4);
+        for (auto buf : bufs) {
+            assert(buf->size == 0 && pkt_buf_tailroom(buf) == room);
+            auto tail = pkt_buf_append(buf, 1500);
+            assert(tail == pkt_buf_data(buf));
+            (void) tail;
+        }
+        pkt_buf_free_batch(bufs, num);
+        mempool_cache_flush(pool);
+        (void) room;
+    }
+}
+
+// a buffer goes back to the pool once the last reference is free'd
+void clone_test() {
+    auto pool = memory_allocate_mempool(2, 2048);
+    auto buf = pkt_buf_alloc(pool);
+    auto other = pkt_buf_alloc(pool);
+    assert(buf && other && buf->refcnt == 1);
+    auto clone = pkt_buf_clone(buf);
+    pkt_buf_clone(buf);
+    assert(clone == buf && buf->refcnt == 3);
+    (void) clone;
+    pkt_buf_free(buf);
+    struct pkt_buf* bufs[] = {buf, other};
+    pkt_buf_free_batch(bufs, 2);
+    // other is back, buf is still referenced
+    assert(buf->refcnt == 1);
+    auto next = pkt_buf_alloc(pool);
+    assert(next == other);
+    next = pkt_buf_alloc(pool);
+    assert(!next);
+    pkt_buf_free(buf);
+    next = pkt_buf_alloc(pool);
+    assert(next == buf && buf->refcnt == 1);
+    (void) next;
+    pkt_buf_free(buf);
+    pkt_buf_free(other);
+}
+
+// batches are served as far as the pool reaches, buffers of several pools can be free'd in one batch
+void batch_test() {
+    auto pool1 = memory_allocate_mempool(64, 2048);
+    auto pool2 = memory_allocate_mempool(16, 2048);
+    struct pkt_buf* bufs[96];
+    uint32_t num1 = pkt_buf_alloc_batch(pool1, bufs, 48);
+    uint32_t num2 = pkt_buf_alloc_batch(pool2, bufs + num1, 48);
+    assert(num1 == 48 && num2 == 16);
+    uint32_t num = pkt_buf_alloc_batch(pool1, bufs + num1 + num2, 32);
+    assert(num == 16);
+    num += num1 + num2;
+    for (uint32_t i = 0; i < num; i++) {
+        assert(bufs[i]->refcnt == 1 && bufs[i]->mempool == (i >= 48 && i < 64 ? pool2 : pool1));
+        for (uint32_t j = 0; j < i; j++)
+            assert(bufs[i] != bufs[j]);
+    }
+    struct pkt_buf* empty;
+    uint32_t none = pkt_buf_alloc_batch(pool1, &empty, 1) + pkt_buf_alloc_batch(pool2, &empty, 1);
+    assert(none == 0);
+    (void) none;
+    pkt_buf_free_batch(bufs, num);
+    num1 = pkt_buf_alloc_batch(pool1, bufs, 96);
+    num2 = pkt_buf_alloc_batch(pool2, bufs + num1, 96);
+    assert(num1 == 64 && num2 == 16);
+    pkt_buf_free_batch(bufs, num1 + num2);
+}
+
+// only the buffers that are used get initialized, in chunks, until the whole pool is
+void lazy_init_test() {
+    struct mempool_params params;
+    mempool_params_init(&params, 1000, 2048);
+    params.flags = MEMPOOL_F_LAZY_INIT;
+    auto pool = memory_allocate_mempool_ext(&params);
+    assert(pool->lazy_init_next == 0 && pool->free_stack_top == 0);
+    auto buf = pkt_buf_alloc(pool);
+    assert(buf && buf->mempool == pool && buf->refcnt == 1 && pkt_buf_headroom(buf) == MEMPOOL_DEFAULT_HEADROOM);
+    assert(pool->lazy_init_next > 1 && pool->lazy_init_next < 1000);
+    pkt_buf_free(buf);
+    std::vector<pkt_buf*> bufs(1001);
+    uint32_t num = pkt_buf_alloc_batch(pool, bufs.data(), 1001);
+    assert(num == 1000 && pool->lazy_init_next == 1000);
+    std::vector<bool> seen(1000);
+    for (uint32_t i = 0; i < num; i++) {
+        assert(bufs[i]->mempool == pool && !seen[bufs[i]->mempool_idx]);
+        seen[bufs[i]->mempool_idx] = true;
+    }
+    pkt_buf_free_batch(bufs.data(), num);
+}
+
+// buffers free'd by a thread stay in its cache up to the high watermark, other threads get them after a flush
+void cache_test() {
+    struct mempool_params params;
+    mempool_params_init(&params, 64, 2048);
+    params.flags = MEMPOOL_F_MT;
+    params.cache_size = 8;
+    auto pool = memory_allocate_mempool_ext(&params);
+    assert(pool->cache_id >= 0 && pool->cache_size == 8);
+    struct pkt_buf* bufs[64];
+    uint32_t num = pkt_buf_alloc_batch(pool, bufs, 64);
+    assert(num == 64);
+    pkt_buf_free_batch(bufs, num);
+    // another thread only sees the buffers that went back to the ring
+    auto alloc_all = [&] {
+        uint32_t n = 0;
+        std::thread t([&] {
+            struct pkt_buf* b[64];
+            n = pkt_buf_alloc_batch(pool, b, 64);
+            pkt_buf_free_batch(b, n);
+            mempool_cache_flush(pool);
+        });
+        t.join();
+        return n;
+    };
+    num = alloc_all();
+    assert(num >= 64 - 12 && num < 64);
+    mempool_cache_flush(pool);
+    num = alloc_all();
+    assert(num == 64);
+    // single buffers take the same path
+    for (auto& buf : bufs) {
+        buf = pkt_buf_alloc(pool);
+        assert(buf && buf->mempool == pool);
+    }
+    for (auto buf : bufs)
+        pkt_buf_free(buf);
+    mempool_cache_flush(pool);
+    num = alloc_all();
+    assert(num == 64);
+}
+
+// a persistent pool left behind by another process is reattached with the content of its buffers
+void persistent_test() {
+    struct mempool_params params;
+    mempool_params_init(&params, 32, 2048);
+    params.name = "ixy-test-persistent";
+    memory_delete_persistent_mempool(params.name);
+    // the memory stays locked as long as its process lives, so the first process is a child
+    pid_t pid = fork();
+    if (pid == 0) {
+        auto pool = memory_allocate_mempool_ext(&params);
+        if (pool->reattached)
+            _exit(1);
+        struct pkt_buf* bufs[32];
+        pkt_buf_alloc_batch(pool, bufs, 32);
+        for (uint32_t i = 0; i < 32; i++)
+            memset(bufs[i]->data, (int) bufs[i]->mempool_idx, 64);
+        _exit(0);
+    }
+    int status = 0;
+    pid_t waited = waitpid(pid, &status, 0);
+    assert(pid > 0 && waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    (void) waited;
+    auto pool = memory_allocate_mempool_ext(&params);
+    assert(pool->reattached);
+    // all buffers are free again, the data is preserved
+    struct pkt_buf* bufs[32];
+    uint32_t num = pkt_buf_alloc_batch(pool, bufs, 32);
+    assert(num == 32);
+    for (uint32_t i = 0; i < num; i++) {
+        assert(bufs[i]->refcnt == 1 && pkt_buf_headroom(bufs[i]) == MEMPOOL_DEFAULT_HEADROOM);
+        assert(bufs[i]->data[0] == bufs[i]->mempool_idx && bufs[i]->data[63] == bufs[i]->mempool_idx);
+    }
+    pkt_buf_free_batch(bufs, num);
+    memory_delete_persistent_mempool(params.name);
+}
+
+// the packet of an external buffer is in the external memory, not in the header-only pool buffer
+void ext_buf_test() {
+    auto pool = memory_allocate_mempool(4, 256);
+    auto mem = dma_allocator_t.allocate(&dma_allocator_t, hugepage_size());
+    auto region = memory_register_ext_region(&mem, count_free_cb);
+    auto frame = (uint8_t*) mem.ptr + 1000;
+    // 4 bytes of metadata in front of an ARP frame
+    memset(frame, 0, 4 + 64);
+    frame[4 + 12] = 0x08;
+    frame[4 + 13] = 0x06;
+    int freed = 0;
+    auto buf = pkt_buf_attach_ext(pool, region, frame, 4 + 64, &freed);
+    assert(buf && pkt_buf_data(buf) == frame);
+    assert(pkt_buf_data_phy(buf) == region->page_phys[0] + 1000);
+    assert(!exception_path_is_slow_path(buf));
+    auto data = pkt_buf_adj(buf, 4);
+    assert(data == frame + 4);
+    assert(buf->size == 64 && pkt_buf_data_phy(buf) == region->page_phys[0] + 1004);
+    assert(exception_path_is_slow_path(buf));
+    data = pkt_buf_prepend(buf, 4);
+    assert(data == frame);
+    data = pkt_buf_prepend(buf, 1);
+    assert(!data);
+    // the external memory belongs to the application, nothing can be appended
+    data = pkt_buf_append(buf, 1);
+    assert(!data);
+    (void) data;
+    pkt_buf_free(buf);
+    assert(freed == 1);
+    // the header goes back to the pool as a regular buffer
+    buf = pkt_buf_alloc(pool);
+    assert(buf && !buf->ext_addr && pkt_buf_headroom(buf) == MEMPOOL_DEFAULT_HEADROOM);
+    pkt_buf_free(buf);
+}
+
+// buffers of a composition of pools go back to the pool they came from
+void allocator_composition_test() {
+    auto small = memory_allocate_mempool(2, 2048);
+    auto large = memory_allocate_mempool(4, 2048);
+    auto a = fallback_allocator_new(mempool_allocator(small), mempool_allocator(large));
+    struct pkt_buf* bufs[8];
+    uint32_t num_bufs = pkt_buf_alloc_batch_from(a, bufs, 8);
+    assert(num_bufs == 6);
+    assert(bufs[0]->mempool == small && bufs[1]->mempool == small);
+    for (int i = 2; i < 6; i++)
+        assert(bufs[i]->mempool == large);
+    auto buf = pkt_buf_alloc_from(a);
+    assert(!buf);
+    pkt_buf_free(bufs[0]);
+    pkt_buf_free(bufs[5]);
+    buf = pkt_buf_alloc_from(a);
+    assert(buf == bufs[0]);
+    buf = pkt_buf_alloc_from(a);
+    assert(buf == bufs[5]);
+    pkt_buf_free_batch(bufs, num_bufs);
+    // a plain pool is called directly
+    buf = pkt_buf_alloc_from(mempool_allocator(large));
+    assert(buf && buf->mempool == large);
+    pkt_buf_free(buf);
+    fallback_allocator_free(a);
+}
+
+// runs f in a child process, returns true if it was stopped by error()
+template<typename F>
+static bool aborts(F f) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        f();
+        _exit(0);
+    }
+    int status = 0;
+    pid_t waited = waitpid(pid, &status, 0);
+    assert(pid > 0 && waited == pid);
+    (void) waited;
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+// the rx path refills its descriptors through a composition with buffers that carried full frames before
+// the room for a frame must not depend on the packet a buffer held last
+void rx_refill_composition_test() {
+    const uint32_t min_rx_buf_room = 1518;
+    auto primary = memory_allocate_mempool(4, 2048);
+    auto secondary = memory_allocate_mempool(4, 2048);
+    auto a = fallback_allocator_new(mempool_allocator(primary), mempool_allocator(secondary));
+    struct pkt_buf* stash[32];
+    for (int round = 0; round < 3; round++) {
+        uint32_t num = pkt_buf_alloc_batch_from(a, stash, 32);
+        assert(num == 8);
+        for (uint32_t i = 0; i < num; i++) {
+            assert(pkt_buf_capacity(stash[i]) >= min_rx_buf_room && pkt_buf_tailroom(stash[i]) == pkt_buf_capacity(stash[i]));
+            // received a full frame
+            auto tail = pkt_buf_append(stash[i], 1500);
+            assert(tail && pkt_buf_capacity(stash[i]) >= min_rx_buf_room && pkt_buf_tailroom(stash[i]) < min_rx_buf_room);
+            (void) tail;
+        }
+        pkt_buf_free_batch(stash, num);
+    }
+    (void) min_rx_buf_room;
+    fallback_allocator_free(a);
+}
+
+// memory that is not a packet buffer stops the program instead of being used as one
+void allocator_rejection_test() {
+    auto pool = memory_allocate_mempool(1, 2048);
+    auto stack = stack_allocator_new(1, 2048, &mallocator_t);
+    auto a = fallback_allocator_new(mempool_allocator(pool), stack);
+    auto buf = pkt_buf_alloc_from(a);
+    assert(buf && buf->mempool == pool);
+    // the pool is empty, the stack hands out its entry
+    assert(aborts([&] { pkt_buf_alloc_from(a); }));
+    pkt_buf_free(buf);
+    fallback_allocator_free(a);
+    stack_allocator_free(stack);
+}
+
+// only one pool can use the memory of a persistent pool, in this or any other process
+void persistent_lock_test() {
+    struct mempool_params params;
+    mempool_params_init(&params, 16, 2048);
+    params.name = "ixy-test-lock";
+    memory_delete_persistent_mempool(params.name);
+    auto pool = memory_allocate_mempool_ext(&params);
+    assert(pool && !pool->reattached);
+    // the child has its own open file, the lock is not inherited
+    assert(aborts([&] { memory_allocate_mempool_ext(&params); }));
+    // a deleted name can be used again while the old pool stays valid
+    memory_delete_persistent_mempool(params.name);
+    auto pool2 = memory_allocate_mempool_ext(&params);
+    auto buf = pkt_buf_alloc(pool);
+    auto buf2 = pkt_buf_alloc(pool2);
+    assert(buf && buf2 && buf->mempool == pool && buf2->mempool == pool2);
+    pkt_buf_free(buf);
+    pkt_buf_free(buf2);
+    memory_delete_persistent_mempool(params.name);
+}
+
+int main() {
+    const char* mount = getenv("IXY_HUGETLBFS") ? getenv("IXY_HUGETLBFS") : HUGETLBFS_DEFAULT_MOUNT;
+    if (geteuid() != 0 || access(mount, W_OK)) {
+        printf("skipped: needs root and a writable hugetlbfs at %s\n", mount);
+        return 77;
+    }
+    headroom_test();
+    reuse_test();
+    clone_test();
+    batch_test();
+    lazy_init_test();
+    cache_test();
+    persistent_test();
+    ext_buf_test();
+    allocator_composition_test();
+    rx_refill_composition_test();
+    allocator_rejection_test();
+    persistent_lock_test();
+}
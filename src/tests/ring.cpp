@@ -0,0 +1,86 @@
+#include "ring.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+// Same approach as the allocator tests, to be replaced by real test framework
+
+void create_free_test() {
+    auto r = ring_create(100);
+    assert(r->size == 128);
+    ring_free(r);
+}
+
+void bulk_burst_test() {
+    auto r = ring_create(8);
+    uint32_t objs[16];
+    for (uint32_t i = 0; i < 16; ++i)
+        objs[i] = i;
+    // bulk is all or nothing
+    uint32_t num = ring_enqueue_bulk(r, objs, 16);
+    assert(num == 0);
+    num = ring_enqueue_bulk(r, objs, 6);
+    assert(num == 6);
+    // burst enqueues as much as possible
+    num = ring_enqueue_burst(r, objs + 6, 10);
+    assert(num == 2 && ring_count(r) == 8);
+    uint32_t out[16];
+    num = ring_dequeue_bulk(r, out, 9);
+    assert(num == 0);
+    num = ring_dequeue_burst(r, out, 16);
+    assert(num == 8);
+    for (uint32_t i = 0; i < num; ++i)
+        assert(out[i] == i);
+    ring_free(r);
+}
+
+// every value is passed through the ring exactly once, no matter how many producers and consumers there are
+void mpmc_test() {
+    const uint32_t num_threads = 2;
+    const uint32_t per_thread = 20000;
+    auto r = ring_create(64);
+    std::vector<std::atomic<uint32_t>> seen(num_threads * per_thread);
+    std::atomic<uint32_t> consumed(0);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (uint32_t i = 0; i < per_thread;) {
+                uint32_t objs[8];
+                uint32_t n = std::min(8u, per_thread - i);
+                for (uint32_t j = 0; j < n; ++j)
+                    objs[j] = t * per_thread + i + j;
+                uint32_t enqueued = ring_enqueue_burst(r, objs, n);
+                if (!enqueued)
+                    std::this_thread::yield();
+                i += enqueued;
+            }
+        });
+        threads.emplace_back([&]() {
+            while (consumed < num_threads * per_thread) {
+                uint32_t objs[8];
+                uint32_t n = ring_dequeue_burst(r, objs, 8);
+                if (!n)
+                    std::this_thread::yield();
+                for (uint32_t j = 0; j < n; ++j)
+                    seen[objs[j]]++;
+                consumed += n;
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    for (auto& s : seen) {
+        assert(s == 1);
+        (void) s;
+    }
+    assert(ring_count(r) == 0);
+    ring_free(r);
+}
+
+int main() {
+    create_free_test();
+    bulk_burst_test();
+    mpmc_test();
+}